@@ -8,16 +8,21 @@
  * (C) Robert C. Helling 2013 and released under the GPLv2
  *
  * add_segment()	- add <seconds> at the given pressure, breathing gasmix
+ * add_segments()	- add <count> times <seconds> at the given pressure in one step
  * deco_allowed_depth() - ceiling based on lead tissue, surface pressure, 3m increments or smooth
  * set_gf()		- set Buehlmann gradient factors
  * clear_deco()
  * cache_deco_state()
  * restore_deco_state()
+ * deco_config_checksum()
+ * deco_loading_checksum()
+ * deco_tissue_tolerance()
  * dump_tissues()
  */
 #include <math.h>
 #include <string.h>
 #include "dive.h"
+#include "sha1.h"
 #include <assert.h>
 
 //! Option structure for Buehlmann decompression.
@@ -89,22 +94,19 @@ double tolerated_by_tissue[16];
 double tissue_inertgas_saturation[16];
 double buehlmann_inertgas_a[16], buehlmann_inertgas_b[16];
 
-static double tissue_tolerance_calc(const struct dive *dive)
+/* The tolerated ambient pressure of the current tissue saturation for the given
+ * gradient factors. gf_low applies at *gf_low_pressure, which is pushed down to
+ * the deepest ceiling seen so far unless gf_low is used at the max depth. */
+static double gf_tolerance_calc(const struct dive *dive, double gf_low, double gf_high, double *gf_low_pressure,
+				double *tolerated_by, int *guiding_tissue)
 {
 	int ci = -1;
 	double ret_tolerance_limit_ambient_pressure = 0.0;
-	double gf_high = buehlmann_config.gf_high;
-	double gf_low = buehlmann_config.gf_low;
 	double surface = get_surface_pressure_in_mbar(dive, true) / 1000.0;
 	double lowest_ceiling = 0.0;
 	double tissue_lowest_ceiling[16];
 
 	for (ci = 0; ci < 16; ci++) {
-		tissue_inertgas_saturation[ci] = tissue_n2_sat[ci] + tissue_he_sat[ci];
-		buehlmann_inertgas_a[ci] = ((buehlmann_N2_a[ci] * tissue_n2_sat[ci]) + (buehlmann_He_a[ci] * tissue_he_sat[ci])) / tissue_inertgas_saturation[ci];
-		buehlmann_inertgas_b[ci] = ((buehlmann_N2_b[ci] * tissue_n2_sat[ci]) + (buehlmann_He_b[ci] * tissue_he_sat[ci])) / tissue_inertgas_saturation[ci];
-
-
 		/* tolerated = (tissue_inertgas_saturation - buehlmann_inertgas_a) * buehlmann_inertgas_b; */
 
 		tissue_lowest_ceiling[ci] = (buehlmann_inertgas_b[ci] * tissue_inertgas_saturation[ci] - gf_low * buehlmann_inertgas_a[ci] * buehlmann_inertgas_b[ci]) /
@@ -112,35 +114,48 @@ static double tissue_tolerance_calc(const struct dive *dive)
 		if (tissue_lowest_ceiling[ci] > lowest_ceiling)
 			lowest_ceiling = tissue_lowest_ceiling[ci];
 		if (!buehlmann_config.gf_low_at_maxdepth) {
-			if (lowest_ceiling > gf_low_pressure_this_dive)
-				gf_low_pressure_this_dive = lowest_ceiling;
+			if (lowest_ceiling > *gf_low_pressure)
+				*gf_low_pressure = lowest_ceiling;
 		}
 	}
 	for (ci = 0; ci <16; ci++) {
 		double tolerated;
 
 		if ((surface / buehlmann_inertgas_b[ci] + buehlmann_inertgas_a[ci] - surface) * gf_high + surface <
-		    (gf_low_pressure_this_dive / buehlmann_inertgas_b[ci] + buehlmann_inertgas_a[ci] - gf_low_pressure_this_dive) * gf_low + gf_low_pressure_this_dive)
-			tolerated = (-buehlmann_inertgas_a[ci] * buehlmann_inertgas_b[ci] * (gf_high * gf_low_pressure_this_dive - gf_low * surface) -
-				     (1.0 - buehlmann_inertgas_b[ci]) * (gf_high - gf_low) * gf_low_pressure_this_dive * surface +
-				     buehlmann_inertgas_b[ci] * (gf_low_pressure_this_dive - surface) * tissue_inertgas_saturation[ci]) /
+		    (*gf_low_pressure / buehlmann_inertgas_b[ci] + buehlmann_inertgas_a[ci] - *gf_low_pressure) * gf_low + *gf_low_pressure)
+			tolerated = (-buehlmann_inertgas_a[ci] * buehlmann_inertgas_b[ci] * (gf_high * *gf_low_pressure - gf_low * surface) -
+				     (1.0 - buehlmann_inertgas_b[ci]) * (gf_high - gf_low) * *gf_low_pressure * surface +
+				     buehlmann_inertgas_b[ci] * (*gf_low_pressure - surface) * tissue_inertgas_saturation[ci]) /
 				    (-buehlmann_inertgas_a[ci] * buehlmann_inertgas_b[ci] * (gf_high - gf_low) +
-				     (1.0 - buehlmann_inertgas_b[ci]) * (gf_low * gf_low_pressure_this_dive - gf_high * surface) +
-				     buehlmann_inertgas_b[ci] * (gf_low_pressure_this_dive - surface));
+				     (1.0 - buehlmann_inertgas_b[ci]) * (gf_low * *gf_low_pressure - gf_high * surface) +
+				     buehlmann_inertgas_b[ci] * (*gf_low_pressure - surface));
 		else
 			tolerated = ret_tolerance_limit_ambient_pressure;
 
 
-		tolerated_by_tissue[ci] = tolerated;
+		tolerated_by[ci] = tolerated;
 
 		if (tolerated >= ret_tolerance_limit_ambient_pressure) {
-			ci_pointing_to_guiding_tissue = ci;
+			*guiding_tissue = ci;
 			ret_tolerance_limit_ambient_pressure = tolerated;
 		}
 	}
 	return ret_tolerance_limit_ambient_pressure;
 }
 
+static double tissue_tolerance_calc(const struct dive *dive)
+{
+	int ci;
+
+	for (ci = 0; ci < 16; ci++) {
+		tissue_inertgas_saturation[ci] = tissue_n2_sat[ci] + tissue_he_sat[ci];
+		buehlmann_inertgas_a[ci] = ((buehlmann_N2_a[ci] * tissue_n2_sat[ci]) + (buehlmann_He_a[ci] * tissue_he_sat[ci])) / tissue_inertgas_saturation[ci];
+		buehlmann_inertgas_b[ci] = ((buehlmann_N2_b[ci] * tissue_n2_sat[ci]) + (buehlmann_He_b[ci] * tissue_he_sat[ci])) / tissue_inertgas_saturation[ci];
+	}
+	return gf_tolerance_calc(dive, buehlmann_config.gf_low, buehlmann_config.gf_high, &gf_low_pressure_this_dive,
+				 tolerated_by_tissue, &ci_pointing_to_guiding_tissue);
+}
+
 /*
  * Return buelman factor for a particular period and tissue index.
  *
@@ -209,6 +224,53 @@ double add_segment(double pressure, const struct gasmix *gasmix, int period_in_s
 	return tissue_tolerance_calc(dive);
 }
 
+/*
+ * Add count periods of period_in_seconds at the same pressure in one go.
+ * At constant pressure the over- or undersaturation of each tissue keeps its
+ * sign and shrinks by the same factor every period, so the tissues end up
+ * where count calls of add_segment() would take them (up to rounding), for
+ * the price of one call.
+ * Unless gf_low applies at the max depth, it follows the deepest ceiling
+ * after each of the periods. That ceiling needn't move in one direction,
+ * e.g. while off-gassing helium after a switch to a nitrox, so then we have
+ * to go through the periods one by one.
+ */
+double add_segments(double pressure, const struct gasmix *gasmix, int period_in_seconds, int count, int ccpo2, const struct dive *dive, int sac)
+{
+	int ci;
+	struct gas_pressures pressures;
+
+	if (count <= 0)
+		return tissue_tolerance_calc(dive);
+
+	if (!buehlmann_config.gf_low_at_maxdepth) {
+		double tolerance;
+
+		do
+			tolerance = add_segment(pressure, gasmix, period_in_seconds, ccpo2, dive, sac);
+		while (--count);
+		return tolerance;
+	}
+
+	fill_pressures(&pressures, pressure - WV_PRESSURE, gasmix, (double) ccpo2 / 1000.0, dive->dc.divemode);
+
+	if (buehlmann_config.gf_low_at_maxdepth && pressure > gf_low_pressure_this_dive)
+		gf_low_pressure_this_dive = pressure;
+
+	for (ci = 0; ci < 16; ci++) {
+		double pn2_oversat = pressures.n2 - tissue_n2_sat[ci];
+		double phe_oversat = pressures.he - tissue_he_sat[ci];
+		double n2_f = n2_factor(period_in_seconds, ci);
+		double he_f = he_factor(period_in_seconds, ci);
+		double n2_satmult = pn2_oversat > 0 ? buehlmann_config.satmult : buehlmann_config.desatmult;
+		double he_satmult = phe_oversat > 0 ? buehlmann_config.satmult : buehlmann_config.desatmult;
+
+		tissue_n2_sat[ci] += pn2_oversat * (1.0 - pow(1.0 - n2_satmult * n2_f, count));
+		tissue_he_sat[ci] += phe_oversat * (1.0 - pow(1.0 - he_satmult * he_f, count));
+	}
+	return tissue_tolerance_calc(dive);
+}
+
 #ifdef DECO_CALC_DEBUG
 void dump_tissues()
 {
@@ -240,7 +302,7 @@ void cache_deco_state(double tissue_tolerance, char **cached_datap)
 	char *data = *cached_datap;
 
 	if (!data) {
-		data = malloc(2 * TISSUE_ARRAY_SZ + 2 * sizeof(double) + sizeof(int));
+		data = malloc(DECO_STATE_SIZE);
 		*cached_datap = data;
 	}
 	memcpy(data, tissue_n2_sat, TISSUE_ARRAY_SZ);
@@ -290,6 +352,49 @@ unsigned int deco_allowed_depth(double tissues_tolerance, double surface_pressur
 	return depth;
 }
 
+/* feed the model parameters into a checksum so that cached tissue states
+ * can be invalidated when they were computed with different settings */
+void deco_config_checksum(SHA_CTX *ctx)
+{
+	SHA1_Update(ctx, &buehlmann_config, sizeof(buehlmann_config));
+}
+
+/* the same, but only for the parameters the tissue loading itself depends on;
+ * GF high only enters the tolerance, which deco_tissue_tolerance() recomputes */
+void deco_loading_checksum(SHA_CTX *ctx)
+{
+	SHA1_Update(ctx, &buehlmann_config.satmult, sizeof(buehlmann_config.satmult));
+	SHA1_Update(ctx, &buehlmann_config.desatmult, sizeof(buehlmann_config.desatmult));
+	SHA1_Update(ctx, &buehlmann_config.gf_low_at_maxdepth, sizeof(buehlmann_config.gf_low_at_maxdepth));
+	if (!buehlmann_config.gf_low_at_maxdepth) {
+		SHA1_Update(ctx, &buehlmann_config.gf_low, sizeof(buehlmann_config.gf_low));
+		SHA1_Update(ctx, &buehlmann_config.gf_low_position_min, sizeof(buehlmann_config.gf_low_position_min));
+	}
+}
+
+/* the tissue tolerance of the current tissue state with the current settings */
+double deco_tissue_tolerance(const struct dive *dive)
+{
+	return tissue_tolerance_calc(dive);
+}
+
+/*
+ * The tissue tolerance of the tissue state the last add_segment() left behind,
+ * but for another pair of gradient factors (in percent). The tissue loading
+ * doesn't depend on them, so several pairs can be evaluated along with a single
+ * deco calculation. Every pair needs its own running *gf_low_pressure, started
+ * at gf_low_pressure_this_dive; none of the global deco state is touched.
+ */
+double deco_tolerance_with_gf(const struct dive *dive, short gflow, short gfhigh, double *gf_low_pressure)
+{
+	double tolerated[16];
+	int guiding_tissue;
+
+	if (buehlmann_config.gf_low_at_maxdepth)
+		*gf_low_pressure = gf_low_pressure_this_dive;
+	return gf_tolerance_calc(dive, gflow / 100.0, gfhigh / 100.0, gf_low_pressure, tolerated, &guiding_tissue);
+}
+
 void set_gf(short gflow, short gfhigh, bool gf_low_at_maxdepth)
 {
 	if (gflow != -1)
@@ -1,6 +1,8 @@
 #ifndef DECO_H
 #define DECO_H
 
+#include "sha1.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -11,6 +13,9 @@ extern double tissue_inertgas_saturation[16];
 extern double buehlmann_inertgas_a[16], buehlmann_inertgas_b[16];
 extern double gf_low_pressure_this_dive;
 
+extern void deco_config_checksum(SHA_CTX *ctx);
+extern void deco_loading_checksum(SHA_CTX *ctx);
+
 
 #ifdef __cplusplus
 }
@@ -56,7 +56,12 @@ int event_gasmix_redundant(struct event *ev)
 		he == ev->gas.mix.he.permille;
 }
 
-struct event *add_event(struct divecomputer *dc, int time, int type, int flags, int value, const char *name)
+/*
+ * This doesn't add the name to the global list of event names,
+ * so the git loader can use it on several threads at once, and
+ * remember the names afterwards.
+ */
+struct event *add_event_unlisted(struct divecomputer *dc, int time, int type, int flags, int value, const char *name)
 {
 	int gas_index = -1;
 	struct event *ev, **p;
@@ -100,7 +105,15 @@ struct event *add_event(struct divecomputer *dc, int time, int type, int flags,
 		p = &(*p)->next;
 	ev->next = *p;
 	*p = ev;
-	remember_event(name);
+	return ev;
+}
+
+struct event *add_event(struct divecomputer *dc, int time, int type, int flags, int value, const char *name)
+{
+	struct event *ev = add_event_unlisted(dc, time, type, flags, value, name);
+
+	if (ev)
+		remember_event(name);
 	return ev;
 }
 
@@ -375,7 +388,9 @@ struct dive *alloc_dive(void)
 }
 
 static void free_dc(struct divecomputer *dc);
+static void free_events(struct event *ev);
 static void free_pic(struct picture *picture);
+static void free_extra_data(struct extra_data *ed);
 
 /* this is very different from the copy_divecomputer later in this file;
  * this function actually makes full copies of the content */
@@ -452,6 +467,26 @@ void clear_dive(struct dive *d)
 	memset(d, 0, sizeof(struct dive));
 }
 
+/* free a dive that is in neither the dive table nor a trip */
+void free_dive(struct dive *d)
+{
+	struct divecomputer *dc;
+
+	if (!d)
+		return;
+	/* copy_dc() shares these between copies, so only the owner of the whole dive frees them */
+	for_each_dc (d, dc) {
+		free((void *)dc->serial);
+		free((void *)dc->fw_version);
+		STRUCTURED_LIST_FREE(struct extra_data, dc->extra_data, free_extra_data);
+	}
+	free(d->dc.sample);
+	free((void *)d->dc.model);
+	free_events(d->dc.events);
+	clear_dive(d);
+	free(d);
+}
+
 /* make a true copy that is independent of the source dive;
  * all data structures are duplicated, so the copy can be modified without
  * any impact on the source */
@@ -1356,6 +1391,35 @@ static void fixup_dive_dc(struct dive *dive, struct divecomputer *dc)
 	fixup_dc_events(dc);
 }
 
+static void add_dive_equipment_descriptions(struct dive *dive)
+{
+	int i;
+
+	for (i = 0; i < MAX_CYLINDERS; i++)
+		add_cylinder_description(&dive->cylinder[i].type);
+	for (i = 0; i < MAX_WEIGHTSYSTEMS; i++)
+		add_weightsystem_description(dive->weightsystem + i);
+}
+
+/*
+ * Dives that were fixed up before - like those from a snapshot -
+ * don't go through fixup_dive() again, but the equipment, event
+ * and device lists still need to hear about them.
+ */
+void remember_dive_details(struct dive *dive)
+{
+	struct divecomputer *dc;
+	struct event *ev;
+
+	add_dive_equipment_descriptions(dive);
+	for_each_dc (dive, dc) {
+		if (dc->deviceid && (dc->serial || dc->fw_version))
+			create_device_node(dc->model, dc->deviceid, dc->serial, dc->fw_version, "");
+		for (ev = dc->events; ev; ev = ev->next)
+			remember_event(ev->name);
+	}
+}
+
 struct dive *fixup_dive(struct dive *dive)
 {
 	int i;
@@ -1376,16 +1440,12 @@ struct dive *fixup_dive(struct dive *dive)
 	fixup_cylinder_use(dive); // store indices for CCR oxygen and diluent cylinders
 	for (i = 0; i < MAX_CYLINDERS; i++) {
 		cylinder_t *cyl = dive->cylinder + i;
-		add_cylinder_description(&cyl->type);
 		if (same_rounded_pressure(cyl->sample_start, cyl->start))
 			cyl->start.mbar = 0;
 		if (same_rounded_pressure(cyl->sample_end, cyl->end))
 			cyl->end.mbar = 0;
 	}
-	for (i = 0; i < MAX_WEIGHTSYSTEMS; i++) {
-		weightsystem_t *ws = dive->weightsystem + i;
-		add_weightsystem_description(ws);
-	}
+	add_dive_equipment_descriptions(dive);
 	/* we should always have a uniq ID as that gets assigned during alloc_dive(),
 	 * but we want to make sure... */
 	if (!dive->id)
@@ -2276,6 +2336,13 @@ static void free_dc(struct divecomputer *dc)
 	free(dc);
 }
 
+static void free_extra_data(struct extra_data *ed)
+{
+	free((void *)ed->key);
+	free((void *)ed->value);
+	free(ed);
+}
+
 static void free_pic(struct picture *picture)
 {
 	if (picture) {
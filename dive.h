@@ -345,6 +345,7 @@ struct dive {
 	int id; // unique ID for this dive
 	struct picture *picture_list;
 	int oxygen_cylinder_index, diluent_cylinder_index; // CCR dive cylinder indices
+	unsigned char git_id[20]; // the git tree of the dive, as of the last git load or save
 };
 
 extern int get_cylinder_idx_by_use(struct dive *dive, enum cylinderuse cylinder_use_type);
@@ -639,6 +640,9 @@ extern int match_one_dc(struct divecomputer *a, struct divecomputer *b);
 
 extern void parse_xml_init(void);
 extern int parse_xml_buffer(const char *url, const char *buf, int size, struct dive_table *table, const char **params);
+extern xmlDoc *read_xml_doc(const char *url, const char *buf, const char **params);
+extern int parse_xml_doc(const char *url, xmlDoc *doc, struct dive_table *table);
+extern int parse_csv_buffer(const char *url, const char *buf, int size, struct dive_table *table, const char **params);
 extern void parse_xml_exit(void);
 extern void set_filename(const char *filename, bool force);
 
@@ -659,15 +663,25 @@ extern int save_dives_logic(const char *filename, bool select_only);
 extern int save_dive(FILE *f, struct dive *dive);
 extern int export_dives_xslt(const char *filename, const bool selected, const int units, const char *export_xslt);
 
+extern bool snapshot_applies(void);
+extern int load_snapshot(const char *name, const char *key);
+extern int load_snapshot_dives(const char *name, struct dive_table *table);
+extern void save_snapshot(const char *name, const char *key);
+extern int load_file_snapshot(const char *filename);
+extern void save_file_snapshot(const char *filename);
+extern void hash_dive(struct dive *dive, unsigned char hash[20]);
+
 struct git_oid;
 struct git_repository;
 #define dummy_git_repository ((git_repository *)3ul) /* Random bogus pointer, not NULL */
 extern struct git_repository *is_git_repository(const char *filename, const char **branchp);
 extern int git_save_dives(struct git_repository *, const char *, bool select_only);
 extern int git_load_dives(struct git_repository *, const char *);
+extern int git_old_dives_used;
 extern const char *saved_git_id;
 extern void clear_git_id(void);
 extern void set_git_id(const struct git_oid *);
+extern char *git_snapshot_name(struct git_repository *repo);
 int cylinderuse_from_text(const char *text);
 
 
@@ -692,13 +706,18 @@ extern timestamp_t get_times();
 
 extern xsltStylesheetPtr get_stylesheet(const char *name);
 
+/* Call fn for each of the nr elements of an array, on as many threads as we have CPUs */
+extern void parallel_for_each(void *array, int nr, size_t size, void (*fn)(void *));
+
 extern timestamp_t utc_mktime(struct tm *tm);
 extern void utc_mkdate(timestamp_t, struct tm *tm);
 
 extern struct dive *alloc_dive(void);
+extern void add_dive_to_table(struct dive *dive, struct dive_table *table);
 extern void record_dive_to_table(struct dive *dive, struct dive_table *table);
 extern void record_dive(struct dive *dive);
 extern void clear_dive(struct dive *dive);
+extern void free_dive(struct dive *dive);
 extern void copy_dive(struct dive *s, struct dive *d);
 extern void selective_copy_dive(struct dive *s, struct dive *d, struct dive_components what, bool clear);
 extern struct dive *clone_dive(struct dive *s);
@@ -712,6 +731,7 @@ extern bool has_hr_data(struct divecomputer *dc);
 
 extern void sort_table(struct dive_table *table);
 extern struct dive *fixup_dive(struct dive *dive);
+extern void remember_dive_details(struct dive *dive);
 extern void fixup_dc_duration(struct divecomputer *dc);
 extern int dive_getUniqID(struct dive *d);
 extern unsigned int dc_airtemp(struct divecomputer *dc);
@@ -726,6 +746,7 @@ extern bool is_cylinder_used(struct dive *dive, int idx);
 extern void fill_default_cylinder(cylinder_t *cyl);
 extern void add_gas_switch_event(struct dive *dive, struct divecomputer *dc, int time, int idx);
 extern struct event *add_event(struct divecomputer *dc, int time, int type, int flags, int value, const char *name);
+extern struct event *add_event_unlisted(struct divecomputer *dc, int time, int type, int flags, int value, const char *name);
 extern void remove_event(struct event *event);
 extern void update_event_name(struct dive *d, struct event* event, char *name);
 extern void add_extra_data(struct divecomputer *dc, const char *key, const char *value);
@@ -778,12 +799,17 @@ extern void subsurface_command_line_exit(int *, char ***);
 #define FRACTION(n, x) ((unsigned)(n) / (x)), ((unsigned)(n) % (x))
 
 extern double add_segment(double pressure, const struct gasmix *gasmix, int period_in_seconds, int setpoint, const struct dive *dive, int sac);
+extern double add_segments(double pressure, const struct gasmix *gasmix, int period_in_seconds, int count, int setpoint, const struct dive *dive, int sac);
 extern void clear_deco(double surface_pressure);
 extern void dump_tissues(void);
 extern unsigned int deco_allowed_depth(double tissues_tolerance, double surface_pressure, struct dive *dive, bool smooth);
 extern void set_gf(short gflow, short gfhigh, bool gf_low_at_maxdepth);
 extern void cache_deco_state(double, char **datap);
 extern double restore_deco_state(char *data);
+extern double deco_tissue_tolerance(const struct dive *dive);
+extern double deco_tolerance_with_gf(const struct dive *dive, short gflow, short gfhigh, double *gf_low_pressure);
+/* size of the buffer cache_deco_state() fills in */
+#define DECO_STATE_SIZE (2 * 16 * sizeof(double) + 2 * sizeof(double) + sizeof(int))
 
 /* this should be converted to use our types */
 struct divedatapoint {
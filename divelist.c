@@ -11,6 +11,7 @@
  * int total_weight(struct dive *dive)
  * int get_divenr(struct dive *dive)
  * double init_decompression(struct dive *dive)
+ * void clear_deco_chain_cache(void)
  * void update_cylinder_related_info(struct dive *dive)
  * void dump_trip_list(void)
  * dive_trip_t *find_matching_trip(timestamp_t when)
@@ -43,6 +44,8 @@
 #include "divelist.h"
 #include "display.h"
 #include "planner.h"
+#include "deco.h"
+#include "profile.h"
 
 static short dive_list_changed = false;
 
@@ -343,14 +346,122 @@ int get_divenr(struct dive *dive)
 
 static struct gasmix air = { .o2.permille = O2_IN_AIR, .he.permille = 0 };
 
+/*
+ * Tissue state at the end of each dive of a chain of repetitive dives, so
+ * that showing the last dive of a liveaboard week doesn't re-simulate the
+ * whole week.
+ *
+ * Each entry is keyed by a checksum over the key of the previous dive in
+ * the chain, everything of this dive that goes into the tissue calculation
+ * and the deco settings. Editing an earlier dive therefore changes the key
+ * of every later dive and the stale states simply stop matching.
+ *
+ * Nothing of the dive we calculate for goes into the keys, so the next dive
+ * of the chain finds the states its predecessor left behind. That's also
+ * why the tolerance stored with a state is never used: it gets calculated
+ * again for the dive at hand.
+ *
+ * Only the last DECO_CHAIN_CACHE_SIZE dives calculated keep their state.
+ * That's plenty for a couple of weeks of diving, and a chain that's longer
+ * still just has to redo the dives before the first state it finds.
+ */
+#define DECO_KEY_SIZE 20
+#define DECO_CHAIN_CACHE_SIZE 64
+
+static struct deco_chain_entry {
+	int id;
+	unsigned char key[DECO_KEY_SIZE];
+	timestamp_t lasttime;
+	unsigned int lastuse;
+	char *state;
+} deco_chain[DECO_CHAIN_CACHE_SIZE];
+static unsigned int deco_chain_use;
+
+static struct deco_chain_entry *get_deco_chain_entry(int id, bool create)
+{
+	int i;
+	struct deco_chain_entry *entry, *slot = deco_chain;
+
+	for (i = 0; i < DECO_CHAIN_CACHE_SIZE; i++) {
+		entry = deco_chain + i;
+		if (entry->state && entry->id == id) {
+			entry->lastuse = ++deco_chain_use;
+			return entry;
+		}
+		/* an unused entry, otherwise the least recently used one */
+		if (slot->state && (!entry->state || entry->lastuse < slot->lastuse))
+			slot = entry;
+	}
+	if (!create)
+		return NULL;
+	/* the state buffer gets reused */
+	slot->id = id;
+	slot->lasttime = 0;
+	slot->lastuse = ++deco_chain_use;
+	return slot;
+}
+
+void clear_deco_chain_cache(void)
+{
+	int i;
+
+	for (i = 0; i < DECO_CHAIN_CACHE_SIZE; i++) {
+		free(deco_chain[i].state);
+		deco_chain[i].state = NULL;
+	}
+}
+
+/* the start of a chain only depends on the settings the tissue loading uses */
+static void deco_chain_seed(unsigned char *key)
+{
+	SHA_CTX ctx;
+
+	SHA1_Init(&ctx);
+	deco_loading_checksum(&ctx);
+	/* the gas in the loop of a PSCR depends on how much the diver breathes */
+	SHA1_Update(&ctx, &prefs.bottomsac, sizeof(prefs.bottomsac));
+	SHA1_Update(&ctx, &prefs.decosac, sizeof(prefs.decosac));
+	SHA1_Update(&ctx, &prefs.o2consumption, sizeof(prefs.o2consumption));
+	SHA1_Update(&ctx, &prefs.pscr_ratio, sizeof(prefs.pscr_ratio));
+	SHA1_Final(key, &ctx);
+}
+
+static void deco_chain_key(unsigned char *key, const unsigned char *prevkey, struct dive *dive)
+{
+	SHA_CTX ctx;
+	struct divecomputer *dc = &dive->dc;
+	int i, surface_pressure = get_surface_pressure_in_mbar(dive, true);
+
+	SHA1_Init(&ctx);
+	SHA1_Update(&ctx, prevkey, DECO_KEY_SIZE);
+	SHA1_Update(&ctx, &dive->when, sizeof(dive->when));
+	SHA1_Update(&ctx, &dive->duration.seconds, sizeof(dive->duration.seconds));
+	SHA1_Update(&ctx, &surface_pressure, sizeof(surface_pressure));
+	SHA1_Update(&ctx, &dive->salinity, sizeof(dive->salinity));
+	SHA1_Update(&ctx, &dc->divemode, sizeof(dc->divemode));
+	SHA1_Update(&ctx, &dive->sac, sizeof(dive->sac));
+	for (i = 0; i < MAX_CYLINDERS; i++)
+		SHA1_Update(&ctx, &dive->cylinder[i].gasmix, sizeof(struct gasmix));
+	for (i = 0; i < dc->samples; i++) {
+		struct sample *sample = dc->sample + i;
+		int data[4] = { sample->time.seconds, sample->depth.mm, sample->sensor, sample->setpoint.mbar };
+
+		SHA1_Update(&ctx, data, sizeof(data));
+	}
+	SHA1_Final(key, &ctx);
+}
+
 /* take into account previous dives until there is a 48h gap between dives */
 double init_decompression(struct dive *dive)
 {
-	int i, divenr = -1;
+	int i, j, first, end, hit = -1, divenr = -1;
 	unsigned int surface_time;
 	timestamp_t when, lasttime = 0, laststart = 0;
 	bool deco_init = false;
 	double tissue_tolerance, surface_pressure;
+	unsigned char seed[DECO_KEY_SIZE], (*keys)[DECO_KEY_SIZE] = NULL;
+	const unsigned char *key = seed;
+	struct deco_chain_entry *entry, *hit_entry = NULL;
 
 	if (!dive)
 		return 0.0;
@@ -379,7 +490,35 @@ double init_decompression(struct dive *dive)
 		when = pdive->when;
 		lasttime = when + pdive->duration.seconds;
 	}
-	while (++i < (divenr >= 0 ? divenr : dive_table.nr)) {
+	/* compute the chain keys and find the latest dive with a valid cached state */
+	first = i + 1;
+	end = divenr >= 0 ? divenr : dive_table.nr;
+	if (end > first)
+		keys = malloc((end - first) * sizeof(*keys));
+	deco_chain_seed(seed);
+	for (j = first; j < end; j++) {
+		struct dive *pdive = get_dive(j);
+		if (dive->divetrip && dive->divetrip != pdive->divetrip)
+			continue;
+		deco_chain_key(keys[j - first], key, pdive);
+		key = keys[j - first];
+		entry = get_deco_chain_entry(pdive->id, false);
+		if (entry && entry->state && !memcmp(entry->key, key, DECO_KEY_SIZE)) {
+			hit = j;
+			hit_entry = entry;
+		}
+	}
+	if (hit_entry) {
+		restore_deco_state(hit_entry->state);
+		lasttime = hit_entry->lasttime;
+		deco_init = true;
+		i = hit;
+#if DECO_CALC_DEBUG & 2
+		printf("restored state after dive #%d\n", get_dive(hit)->number);
+		dump_tissues();
+#endif
+	}
+	while (++i < end) {
 		struct dive *pdive = get_dive(i);
 		/* again skip dives from different trips */
 		if (dive->divetrip && dive->divetrip != pdive->divetrip)
@@ -401,13 +540,22 @@ double init_decompression(struct dive *dive)
 		if (pdive->when > lasttime) {
 			surface_time = pdive->when - lasttime;
 			lasttime = pdive->when + pdive->duration.seconds;
-			tissue_tolerance = add_segment(surface_pressure, &air, surface_time, 0, dive, prefs.decosac);
+			/* the dive mode we pass only matters for PSCR, and shouldn't be the one of a later dive */
+			tissue_tolerance = add_segment(surface_pressure, &air, surface_time, 0, pdive, prefs.decosac);
 #if DECO_CALC_DEBUG & 2
 			printf("after surface intervall of %d:%02u\n", FRACTION(surface_time, 60));
 			dump_tissues();
 #endif
 		}
+		entry = get_deco_chain_entry(pdive->id, true);
+		memcpy(entry->key, keys[i - first], DECO_KEY_SIZE);
+		entry->lasttime = lasttime;
+		cache_deco_state(tissue_tolerance, &entry->state);
 	}
+	free(keys);
+	/* the tolerance so far was for the earlier dives */
+	if (deco_init)
+		tissue_tolerance = deco_tissue_tolerance(dive);
 	/* add the final surface time */
 	if (lasttime && dive->when > lasttime) {
 		surface_time = dive->when - lasttime;
@@ -907,6 +1055,8 @@ void combine_trips(struct dive_trip *trip_a, struct dive_trip *trip_b)
 void mark_divelist_changed(int changed)
 {
 	dive_list_changed = changed;
+	if (changed)
+		invalidate_plot_info_cache();
 }
 
 int unsaved_changes()
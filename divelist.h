@@ -12,6 +12,7 @@ extern void mark_divelist_changed(int);
 extern int unsaved_changes(void);
 extern void remove_autogen_trips(void);
 extern double init_decompression(struct dive *dive);
+extern void clear_deco_chain_cache(void);
 
 /* divelist core logic functions */
 extern void process_dives(bool imported, bool prefer_imported);
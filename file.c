@@ -4,6 +4,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
 #include "gettext.h"
 #include <zip.h>
 #include <time.h>
@@ -30,6 +33,7 @@ int readfile(const char *filename, struct memblock *mem)
 
 	mem->buffer = NULL;
 	mem->size = 0;
+	mem->mapped = false;
 
 	fd = subsurface_open(filename, O_RDONLY | O_BINARY, 0);
 	if (fd < 0)
@@ -67,20 +71,107 @@ out:
 	return ret;
 }
 
+/*
+ * Like readfile(), but the file gets mapped instead of read where that's
+ * possible, so a large file isn't copied into memory before parsing it.
+ * The mapping is private and writable, parsers may change the buffer in
+ * place just like the one readfile() returns. That one is NUL terminated,
+ * which a mapping only is if the file doesn't end on a page boundary -
+ * those files are read, as they are where there's no mmap().
+ * The buffer has to be released with free_memblock().
+ */
+int mapfile(const char *filename, struct memblock *mem)
+{
+#ifndef WIN32
+	int fd;
+	struct stat st;
+	void *map;
+	long pagesize = sysconf(_SC_PAGESIZE);
+
+	mem->buffer = NULL;
+	mem->size = 0;
+	mem->mapped = false;
+
+	fd = subsurface_open(filename, O_RDONLY | O_BINARY, 0);
+	if (fd < 0)
+		return fd;
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size && pagesize > 0 && st.st_size % pagesize) {
+		map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			close(fd);
+			mem->buffer = map;
+			mem->size = st.st_size;
+			mem->mapped = true;
+			return mem->size;
+		}
+	}
+	close(fd);
+#endif
+	return readfile(filename, mem);
+}
 
-static void zip_read(struct zip_file *file, const char *filename)
+void free_memblock(struct memblock *mem)
 {
-	int size = 1024, n, read = 0;
-	char *mem = malloc(size);
+#ifndef WIN32
+	if (mem->mapped)
+		munmap(mem->buffer, mem->size);
+	else
+#endif
+		free(mem->buffer);
+	mem->buffer = NULL;
+	mem->size = 0;
+	mem->mapped = false;
+}
+
 
-	while ((n = zip_fread(file, mem + read, size - read)) > 0) {
-		read += n;
-		size = read * 3 / 2;
-		mem = realloc(mem, size);
+/* size is what the archive says the member has, zero if it doesn't know */
+static char *zip_read(struct zip_file *file, zip_uint64_t size)
+{
+	zip_int64_t n;
+	size_t read = 0;
+	char *mem;
+
+	if (size) {
+		/* read it into a buffer of the right size in one go */
+		mem = malloc(size + 1);
+		if (!mem)
+			return NULL;
+		while (read < size && (n = zip_fread(file, mem + read, size - read)) > 0)
+			read += n;
+	} else {
+		size = 1024;
+		mem = malloc(size);
+		while ((n = zip_fread(file, mem + read, size - read)) > 0) {
+			read += n;
+			size = read * 3 / 2;
+			mem = realloc(mem, size);
+		}
 	}
 	mem[read] = 0;
-	(void) parse_xml_buffer(filename, mem, read, &dive_table, NULL);
-	free(mem);
+	return mem;
+}
+
+/*
+ * The members of an archive are read one after the other, libzip
+ * can't do more at a time, but parsing and transforming them (by far
+ * the most work for the big SDE and DLD archives) happens for all of
+ * them at once. Only then do they get added to the dive list, one
+ * after the other in the order of the archive, as that's what the
+ * dive sites and trips in them are matched up with.
+ */
+struct zip_member {
+	const char *filename;
+	char *mem;
+	xmlDoc *doc;
+};
+
+static void read_zip_member(void *data)
+{
+	struct zip_member *member = data;
+
+	member->doc = read_xml_doc(member->filename, member->mem, NULL);
+	free(member->mem);
+	member->mem = NULL;
 }
 
 static int try_to_open_zip(const char *filename, struct memblock *mem)
@@ -90,19 +181,45 @@ static int try_to_open_zip(const char *filename, struct memblock *mem)
 	struct zip *zip = subsurface_zip_open_readonly(filename, ZIP_CHECKCONS, NULL);
 
 	if (zip) {
-		int index;
+		struct zip_member *members = NULL;
+		int index, nr = 0, allocated = 0;
+
 		for (index = 0;; index++) {
-			struct zip_file *file = zip_fopen_index(zip, index, 0);
-			if (!file)
+			struct zip_stat st;
+			struct zip_file *file;
+			char *buf;
+
+			if (zip_stat_index(zip, index, 0, &st) < 0)
 				break;
 			/* skip parsing the divelogs.de pictures */
-			if (strstr(zip_get_name(zip, index, 0), "pictures/"))
+			if ((st.valid & ZIP_STAT_NAME) && strstr(st.name, "pictures/"))
 				continue;
-			zip_read(file, filename);
+			file = zip_fopen_index(zip, index, 0);
+			if (!file)
+				break;
+			buf = zip_read(file, (st.valid & ZIP_STAT_SIZE) ? st.size : 0);
 			zip_fclose(file);
-			success++;
+			if (!buf)
+				continue;
+			if (nr >= allocated) {
+				allocated = (nr + 8) * 3 / 2;
+				members = realloc(members, allocated * sizeof(*members));
+				if (!members)
+					exit(1);
+			}
+			members[nr].filename = filename;
+			members[nr].mem = buf;
+			members[nr].doc = NULL;
+			nr++;
 		}
 		subsurface_zip_close(zip);
+
+		parallel_for_each(members, nr, sizeof(*members), read_zip_member);
+		for (index = 0; index < nr; index++) {
+			(void) parse_xml_doc(filename, members[index].doc, &dive_table);
+			success++;
+		}
+		free(members);
 	}
 	return success;
 }
@@ -424,12 +541,18 @@ int parse_file(const char *filename)
 	struct memblock mem;
 	char *fmt;
 	int ret;
+	bool snapshot;
 
 	git = is_git_repository(filename, &branch);
 	if (git && !git_load_dives(git, branch))
 		return 0;
 
-	if (readfile(filename, &mem) < 0) {
+	/* Only the default file gets a snapshot, as it sits right next to it */
+	snapshot = prefs.default_filename && !strcmp(filename, prefs.default_filename) && snapshot_applies();
+	if (snapshot && !load_file_snapshot(filename))
+		return 0;
+
+	if (mapfile(filename, &mem) < 0) {
 		/* we don't want to display an error if this was the default file */
 		if (prefs.default_filename && !strcmp(filename, prefs.default_filename))
 			return 0;
@@ -440,34 +563,36 @@ int parse_file(const char *filename)
 	fmt = strrchr(filename, '.');
 	if (fmt && (!strcasecmp(fmt + 1, "DB") || !strcasecmp(fmt + 1, "BAK"))) {
 		if (!try_to_open_db(filename, &mem)) {
-			free(mem.buffer);
+			free_memblock(&mem);
 			return 0;
 		}
 	}
 
 	/* Divesoft Freedom */
 	if (fmt && (!strcasecmp(fmt + 1, "DLF"))) {
-		if (!parse_dlf_buffer(mem.buffer, mem.size)) {
-			free(mem.buffer);
-			return 0;
-		}
-		return -1;
+		ret = parse_dlf_buffer(mem.buffer, mem.size);
+		free_memblock(&mem);
+		return ret ? -1 : 0;
 	}
 
 	/* DataTrak/Wlog */
 	if (fmt && !strcasecmp(fmt + 1, "LOG")) {
+		free_memblock(&mem);
 		datatrak_import(filename, &dive_table);
 		return 0;
 	}
 
 	/* OSTCtools */
 	if (fmt && (!strcasecmp(fmt + 1, "DIVE"))) {
+		free_memblock(&mem);
 		ostctools_import(filename, &dive_table);
 		return 0;
 	}
 
 	ret = parse_file_buffer(filename, &mem);
-	free(mem.buffer);
+	free_memblock(&mem);
+	if (!ret && snapshot)
+		save_file_snapshot(filename);
 	return ret;
 }
 
@@ -611,7 +736,7 @@ int parse_txt_file(const char *filename, const char *csv)
 		 *	39	water temp
 		 */
 
-		if (readfile(csv, &memcsv) < 0) {
+		if (mapfile(csv, &memcsv) < 0) {
 			return report_error(translate("gettextFromC", "Poseidon import failed: unable to read '%s'"), csv);
 		}
 		lineptr = memcsv.buffer;
@@ -795,6 +920,7 @@ int parse_txt_file(const char *filename, const char *csv)
 			if (!lineptr || !*lineptr)
 				break;
 		}
+		free_memblock(&memcsv);
 		record_dive(dive);
 		return 1;
 	} else {
@@ -897,19 +1023,25 @@ int parse_csv_file(const char *filename, int timef, int depthf, int tempf, int p
 	if (filename == NULL)
 		return report_error("No CSV filename");
 
-	mem.size = 0;
-	if (try_to_xslt_open_csv(filename, &mem, csvtemplate))
-		return -1;
-
 	previous = dive_table.nr;
-	ret = parse_xml_buffer(filename, mem.buffer, mem.size, &dive_table, (const char **)params);
+	if (!strcmp(csvtemplate, "csv")) {
+		/* The generic format doesn't need the stylesheet */
+		if (mapfile(filename, &mem) < 0)
+			return report_error(translate("gettextFromC", "Failed to read '%s'"), filename);
+		ret = parse_csv_buffer(filename, mem.buffer, mem.size, &dive_table, (const char **)params);
+	} else {
+		mem.size = 0;
+		if (try_to_xslt_open_csv(filename, &mem, csvtemplate))
+			return -1;
+		ret = parse_xml_buffer(filename, mem.buffer, mem.size, &dive_table, (const char **)params);
+	}
 
 	// mark imported dives as imported from CSV
 	for (int i = previous; i < dive_table.nr; i++)
 		if (same_string(get_dive(i)->dc.model, ""))
 			get_dive(i)->dc.model = copy_string("Imported from CSV");
 
-	free(mem.buffer);
+	free_memblock(&mem);
 	return ret;
 }
 
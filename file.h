@@ -4,6 +4,7 @@
 struct memblock {
 	void *buffer;
 	size_t size;
+	bool mapped;	/* see mapfile() */
 };
 
 extern int try_to_open_cochran(const char *filename, struct memblock *mem);
@@ -15,6 +16,8 @@ extern void ostctools_import(const char *file, struct dive_table *table);
 extern "C" {
 #endif
 extern int readfile(const char *filename, struct memblock *mem);
+extern int mapfile(const char *filename, struct memblock *mem);
+extern void free_memblock(struct memblock *mem);
 extern timestamp_t parse_date(const char *date);
 #ifdef __cplusplus
 }
@@ -10,11 +10,11 @@
  *                                  -> fill_missing_tank_pressures() -> fill_missing_segment_pressures()
  *                                                                   -> get_pr_interpolate_data()
  *
- *  The pr_track_t related functions below implement a linked list that is used by
- *  the majority of the functions below. The linked list covers a part of the dive profile
- *  for which there are no cylinder pressure data. Each element in the linked list
- *  represents a segment between two consecutive points on the dive profile.
- *  pr_track_t is defined in gaspressures.h
+ *  The pr_track_t related functions below implement an array of segments per cylinder that
+ *  is used by the majority of the functions below. The array covers a part of the dive profile
+ *  for which there are no cylinder pressure data. Each element in the array represents a
+ *  segment between two consecutive points on the dive profile.
+ *  pr_track_t and pr_track_list_t are defined in gaspressures.h
  */
 
 #include "dive.h"
@@ -22,58 +22,47 @@
 #include "profile.h"
 #include "gaspressures.h"
 
-static pr_track_t *pr_track_alloc(int start, int t_start)
+/* Append a new segment to the list of a cylinder. The returned pointer
+ * is only valid until the next segment is added to the same list. */
+static pr_track_t *pr_track_add(pr_track_list_t *list, int start, int t_start)
 {
-	pr_track_t *pt = malloc(sizeof(pr_track_t));
+	pr_track_t *pt;
+
+	if (list->nr >= list->allocated) {
+		int allocated = (list->nr + 8) * 3 / 2;
+		pr_track_t *segment = realloc(list->segment, allocated * sizeof(pr_track_t));
+		if (!segment)
+			return NULL;
+		list->segment = segment;
+		list->allocated = allocated;
+	}
+	pt = list->segment + list->nr++;
 	pt->start = start;
 	pt->end = 0;
 	pt->t_start = pt->t_end = t_start;
 	pt->pressure_time = 0;
-	pt->next = NULL;
+	pt->first_entry = pt->last_entry = 0;
 	return pt;
 }
 
-/* poor man's linked list */
-static pr_track_t *list_last(pr_track_t *list)
+static void pr_track_free(pr_track_list_t *list)
 {
-	pr_track_t *tail = list;
-	if (!tail)
-		return NULL;
-	while (tail->next) {
-		tail = tail->next;
-	}
-	return tail;
-}
-
-static pr_track_t *list_add(pr_track_t *list, pr_track_t *element)
-{
-	pr_track_t *tail = list_last(list);
-	if (!tail)
-		return element;
-	tail->next = element;
-	return list;
-}
-
-static void list_free(pr_track_t *list)
-{
-	if (!list)
-		return;
-	list_free(list->next);
-	free(list);
+	free(list->segment);
+	list->segment = NULL;
+	list->nr = list->allocated = 0;
 }
 
 #ifdef DEBUG_PR_TRACK
-static void dump_pr_track(pr_track_t **track_pr)
+static void dump_pr_track(pr_track_list_t *track_pr)
 {
-	int cyl;
+	int cyl, i;
 	pr_track_t *list;
 
 	for (cyl = 0; cyl < MAX_CYLINDERS; cyl++) {
-		list = track_pr[cyl];
-		while (list) {
+		for (i = 0; i < track_pr[cyl].nr; i++) {
+			list = track_pr[cyl].segment + i;
 			printf("cyl%d: start %d end %d t_start %d t_end %d pt %d\n", cyl,
 			       list->start, list->end, list->t_start, list->t_end, list->pressure_time);
-			list = list->next;
 		}
 	}
 }
@@ -97,11 +86,13 @@ static void dump_pr_track(pr_track_t **track_pr)
  * segments according to how big of a time_pressure area
  * they have.
  */
-static void fill_missing_segment_pressures(pr_track_t *list, enum interpolation_strategy strategy)
+static void fill_missing_segment_pressures(pr_track_list_t *track, enum interpolation_strategy strategy)
 {
 	double magic;
+	pr_track_t *list = track->segment;
+	pr_track_t *last = track->segment + track->nr - 1;
 
-	while (list) {
+	while (list <= last) {
 		int start = list->start, end;
 		pr_track_t *tmp = list;
 		int pt_sum = 0, pt = 0;
@@ -112,9 +103,9 @@ static void fill_missing_segment_pressures(pr_track_t *list, enum interpolation_
 			if (end)
 				break;
 			end = start;
-			if (!tmp->next)
+			if (tmp == last)
 				break;
-			tmp = tmp->next;
+			tmp++;
 		}
 
 		if (!start)
@@ -141,7 +132,7 @@ static void fill_missing_segment_pressures(pr_track_t *list, enum interpolation_
 				list->end = pressure;
 				if (list == tmp)
 					break;
-				list = list->next;
+				list++;
 				list->start = pressure;
 			}
 			break;
@@ -158,7 +149,7 @@ static void fill_missing_segment_pressures(pr_track_t *list, enum interpolation_
 		}
 
 		/* Ok, we've done that set of segments */
-		list = list->next;
+		list++;
 	}
 }
 
@@ -171,67 +162,76 @@ void dump_pr_interpolate(int i, pr_interpolate_t interpolate_pr)
 #endif
 
 
-static struct pr_interpolate_struct get_pr_interpolate_data(pr_track_t *segment, struct plot_info *pi, int cur, int pressure)
+/* Index of the first plot entry at (or, if 'after' is set, past) 'sec' */
+static int find_plot_entry(struct plot_info *pi, int sec, bool after)
+{
+	int low = 0, high = pi->nr;
+
+	while (low < high) {
+		int mid = (low + high) / 2;
+		int t = pi->entry[mid].sec;
+
+		if (t < sec || (after && t == sec))
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+/*
+ * Find the plot entries bounding a segment: the pressure-time of a
+ * segment is accumulated from the first entry after t_start up to and
+ * including the first entry at or after t_end.
+ */
+static void set_segment_entries(pr_track_list_t *track, struct plot_info *pi)
+{
+	int i;
+
+	for (i = 0; i < track->nr; i++) {
+		pr_track_t *segment = track->segment + i;
+
+		segment->last_entry = find_plot_entry(pi, segment->t_end, false);
+		segment->first_entry = find_plot_entry(pi, segment->t_start, true);
+		if (segment->first_entry > segment->last_entry)
+			segment->first_entry = segment->last_entry;
+	}
+}
+
+/*
+ * pt_sum[i] is the sum of the pressure_time of the plot entries before
+ * entry i, so the pressure-time of any range of entries is a difference
+ * of two of them.
+ */
+static struct pr_interpolate_struct get_pr_interpolate_data(pr_track_t *segment, struct plot_info *pi, const int *pt_sum, int cur)
 { // cur = index to pi->entry corresponding to t_end of segment;
 	struct pr_interpolate_struct interpolate;
-	int i;
-	struct plot_data *entry;
+	int first = segment->first_entry, last = segment->last_entry;
+	int acc_end = cur + 1;
+
+	if (acc_end > last)
+		acc_end = last;
+	if (acc_end < first)
+		acc_end = first;
 
 	interpolate.start = segment->start;
 	interpolate.end = segment->end;
-	interpolate.acc_pressure_time = 0;
-	interpolate.pressure_time = 0;
-
-	for (i = 0; i < pi->nr; i++) {
-		entry = pi->entry + i;
-
-		if (entry->sec < segment->t_start)
-			continue;
-		if (entry->sec >= segment->t_end) {
-			interpolate.pressure_time += entry->pressure_time;
-			break;
-		}
-		if (entry->sec == segment->t_start) {
-			interpolate.acc_pressure_time = 0;
-			interpolate.pressure_time = 0;
-			if (pressure)
-				interpolate.start = pressure;
-			continue;
-		}
-		if (i < cur) {
-			if (pressure) {
-				interpolate.start = pressure;
-				interpolate.acc_pressure_time = 0;
-				interpolate.pressure_time = 0;
-			} else {
-				interpolate.acc_pressure_time += entry->pressure_time;
-				interpolate.pressure_time += entry->pressure_time;
-			}
-			continue;
-		}
-		if (i == cur) {
-			interpolate.acc_pressure_time += entry->pressure_time;
-			interpolate.pressure_time += entry->pressure_time;
-			continue;
-		}
-		interpolate.pressure_time += entry->pressure_time;
-		if (pressure) {
-			interpolate.end = pressure;
-			break;
-		}
-	}
+	interpolate.acc_pressure_time = pt_sum[acc_end] - pt_sum[first];
+	interpolate.pressure_time = pt_sum[last < pi->nr ? last + 1 : pi->nr] - pt_sum[first];
 	return interpolate;
 }
 
-static void fill_missing_tank_pressures(struct dive *dive, struct plot_info *pi, pr_track_t **track_pr, bool o2_flag)
+static void fill_missing_tank_pressures(struct dive *dive, struct plot_info *pi, pr_track_list_t *track_pr, bool o2_flag)
 {
 	int cyl, i;
 	struct plot_data *entry;
 	int cur_pr[MAX_CYLINDERS]; // cur_pr[MAX_CYLINDERS] is the CCR diluent cylinder
+	int cur_segment[MAX_CYLINDERS] = { 0, };
+	int *pt_sum;
 
 	for (cyl = 0; cyl < MAX_CYLINDERS; cyl++) {
 		enum interpolation_strategy strategy;
-		if (!track_pr[cyl]) {
+		if (!track_pr[cyl].nr) {
 			/* no segment where this cylinder is used */
 			cur_pr[cyl] = -1;
 			continue;
@@ -240,15 +240,25 @@ static void fill_missing_tank_pressures(struct dive *dive, struct plot_info *pi,
 			strategy = SAC;
 		else
 			strategy = TIME;
-		fill_missing_segment_pressures(track_pr[cyl], strategy); // Interpolate the missing tank pressure values ..
-		cur_pr[cyl] = track_pr[cyl]->start;	       // in the pr_track_t lists of structures
-	}						       // and keep the starting pressure for each cylinder.
+		fill_missing_segment_pressures(track_pr + cyl, strategy); // Interpolate the missing tank pressure values ..
+		set_segment_entries(track_pr + cyl, pi);
+		cur_pr[cyl] = track_pr[cyl].segment[0].start;	      // in the pr_track_t arrays of structures
+	}							      // and keep the starting pressure for each cylinder.
 
 #ifdef DEBUG_PR_TRACK
 	/* another great debugging tool */
 	dump_pr_track(track_pr);
 #endif
 
+	/* Running sum of the pressure-time, so that we don't have to
+	 * walk the plot entries of a segment for every missing pressure */
+	pt_sum = malloc((pi->nr + 1) * sizeof(int));
+	if (!pt_sum)
+		return;
+	pt_sum[0] = 0;
+	for (i = 0; i < pi->nr; i++)
+		pt_sum[i + 1] = pt_sum[i] + pi->entry[i].pressure_time;
+
 	/* Transfer interpolated cylinder pressures from pr_track strucktures to plotdata
 	 * Go down the list of tank pressures in plot_info. Align them with the start &
 	 * end times of each profile segment represented by a pr_track_t structure. Get
@@ -272,7 +282,7 @@ static void fill_missing_tank_pressures(struct dive *dive, struct plot_info *pi,
 			// Find the cylinder index (cyl) and pressure
 			cyl = dive->oxygen_cylinder_index;
 			if (cyl < 0)
-				return;   // Can we do this?!?
+				break;    // Can we do this?!?
 			pressure = O2CYLINDER_PRESSURE(entry);
 			save_pressure = &(entry->o2cylinderpressure[SENSOR_PR]);
 			save_interpolated = &(entry->o2cylinderpressure[INTERPOLATED_PR]);
@@ -289,9 +299,11 @@ static void fill_missing_tank_pressures(struct dive *dive, struct plot_info *pi,
 		}
 		// If there is NO valid pressure value..
 		// Find the pressure segment corresponding to this entry..
-		segment = track_pr[cyl];
-		while (segment && segment->t_end < entry->sec) // Find the track_pr with end time..
-			segment = segment->next;	       // ..that matches the plot_info time (entry->sec)
+		// The plot entries are in time order, so we never have to look back
+		while (cur_segment[cyl] < track_pr[cyl].nr &&
+		       track_pr[cyl].segment[cur_segment[cyl]].t_end < entry->sec) // Find the track_pr with end time..
+			cur_segment[cyl]++;					   // ..that matches the plot_info time (entry->sec)
+		segment = cur_segment[cyl] < track_pr[cyl].nr ? track_pr[cyl].segment + cur_segment[cyl] : NULL;
 
 		if (!segment || !segment->pressure_time) { // No (or empty) segment?
 			*save_pressure = cur_pr[cyl];      // Just use our current pressure
@@ -299,7 +311,7 @@ static void fill_missing_tank_pressures(struct dive *dive, struct plot_info *pi,
 		}
 
 		// If there is a valid segment but no tank pressure ..
-		interpolate = get_pr_interpolate_data(segment, pi, i, pressure); // Set up an interpolation structure
+		interpolate = get_pr_interpolate_data(segment, pi, pt_sum, i); // Set up an interpolation structure
 		if(dive->cylinder[cyl].cylinder_use == OC_GAS) {
 
 			/* if this segment has pressure_time, then calculate a new interpolated pressure */
@@ -316,6 +328,7 @@ static void fill_missing_tank_pressures(struct dive *dive, struct plot_info *pi,
 		}
 		*save_interpolated = cur_pr[cyl]; // and store the interpolated data in plot_info
 	}
+	free(pt_sum);
 }
 
 
@@ -356,17 +369,17 @@ static void debug_print_pressures(struct plot_info *pi)
 /* This function goes through the list of tank pressures, either SENSOR_PRESSURE(entry) or O2CYLINDER_PRESSURE(entry),
  * of structure plot_info for the dive profile where each item in the list corresponds to one point (node) of the
  * profile. It finds values for which there are no tank pressures (pressure==0). For each missing item (node) of
- * tank pressure it creates a pr_track_alloc structure that represents a segment on the dive profile and that
- * contains tank pressures. There is a linked list of pr_track_alloc structures for each cylinder. These pr_track_alloc
+ * tank pressure it creates a pr_track_t structure that represents a segment on the dive profile and that
+ * contains tank pressures. There is an array of pr_track_t structures for each cylinder. These pr_track_t
  * structures ultimately allow for filling the missing tank pressure values on the dive profile using the depth_pressure
  * of the dive. To do this, it calculates the summed pressure-time value for the duration of the dive and stores these
- * in the pr_track_alloc structures. If diluent_flag = 1, then DILUENT_PRESSURE(entry) is used instead of SENSOR_PRESSURE.
+ * in the pr_track_t structures. If diluent_flag = 1, then DILUENT_PRESSURE(entry) is used instead of SENSOR_PRESSURE.
  * This function is called by create_plot_info_new() in profile.c
  */
 void populate_pressure_information(struct dive *dive, struct divecomputer *dc, struct plot_info *pi, int o2_flag)
 {
 	int i, cylinderid, cylinderindex = -1;
-	pr_track_t *track_pr[MAX_CYLINDERS] = { NULL, };
+	pr_track_list_t track_pr[MAX_CYLINDERS] = { { 0, }, };
 	pr_track_t *current = NULL;
 	bool missing_pr = false;
 
@@ -397,8 +410,7 @@ void populate_pressure_information(struct dive *dive, struct divecomputer *dc, s
 				cylinderindex = dive->oxygen_cylinder_index; // indicate o2 cylinder
 			else
 				cylinderindex = entry->cylinderindex;
-			current = pr_track_alloc(pressure, entry->sec);
-			track_pr[cylinderindex] = list_add(track_pr[cylinderindex], current);
+			current = pr_track_add(track_pr + cylinderindex, pressure, entry->sec);
 			continue;
 		}
 
@@ -416,8 +428,7 @@ void populate_pressure_information(struct dive *dive, struct divecomputer *dc, s
 			continue;
 
 		/* transmitter stopped transmitting cylinder pressure data */
-		current = pr_track_alloc(pressure, entry->sec);
-		track_pr[cylinderindex] = list_add(track_pr[cylinderindex], current);
+		current = pr_track_add(track_pr + cylinderindex, pressure, entry->sec);
 	}
 
 	if (missing_pr) {
@@ -430,5 +441,5 @@ void populate_pressure_information(struct dive *dive, struct divecomputer *dc, s
 
 GIVE_UP:
 	for (i = 0; i < MAX_CYLINDERS; i++)
-		list_free(track_pr[i]);
+		pr_track_free(track_pr + i);
 }
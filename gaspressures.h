@@ -16,7 +16,15 @@ struct pr_track_struct {
 	int t_start;
 	int t_end;
 	int pressure_time;
-	pr_track_t *next;
+	int first_entry;	/* first plot entry after t_start */
+	int last_entry;		/* first plot entry at or after t_end */
+};
+
+/* the segments of one cylinder, in time order */
+typedef struct pr_track_list_struct pr_track_list_t;
+struct pr_track_list_struct {
+	int nr, allocated;
+	pr_track_t *segment;
 };
 
 typedef struct pr_interpolate_struct pr_interpolate_t;
@@ -276,3 +276,12 @@ struct git_repository *is_git_repository(const char *filename, const char **bran
 	*branchp = branch;
 	return repo;
 }
+
+/*
+ * The snapshot of a repository lives in its git directory,
+ * where it doesn't get in the way of anything.
+ */
+char *git_snapshot_name(struct git_repository *repo)
+{
+	return format_string("%ssubsurface.snapshot", git_repository_path(repo));
+}
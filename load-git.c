@@ -698,7 +698,7 @@ static void parse_dc_event(char *line, struct membuffer *str, void *_dc)
 	name = "";
 	if (str->len)
 		name = mb_cstring(str);
-	ev = add_event(dc, event.time.seconds, event.type, event.flags, event.value, name);
+	ev = add_event_unlisted(dc, event.time.seconds, event.type, event.flags, event.value, name);
 	if (ev && event_is_gaschange(ev)) {
 		/*
 		 * We subtract one here because "0" is "no index",
@@ -1040,7 +1040,6 @@ static void for_each_line(git_blob *blob, line_fn_t *fn, void *fndata)
 #define GIT_WALK_OK   0
 #define GIT_WALK_SKIP 1
 
-static struct divecomputer *active_dc;
 static struct dive *active_dive;
 static dive_trip_t *active_trip;
 
@@ -1054,14 +1053,214 @@ static void finish_active_trip(void)
 	}
 }
 
+/*
+ * Parsing the dive computer files - with all their samples - is
+ * most of the work of loading a dive log. So the tree walk only
+ * looks up their blobs, and we parse them in batches on all the
+ * CPUs we have. The libgit2 calls all stay on this thread.
+ *
+ * Recording a dive fixes it up, which needs the samples, so the
+ * finished dives wait for their batch too. They get recorded in
+ * the order we walked them, along with the dives we could take
+ * from an older snapshot as they were.
+ */
+struct dc_job {
+	struct divecomputer *dc;
+	git_blob *blob;
+};
+
+#define DC_BATCH_SIZE (16 << 20)
+
+static struct dc_job *dc_jobs;
+static int nr_dc_jobs, allocated_dc_jobs;
+static size_t dc_job_bytes;
+
+struct pending_dive {
+	struct dive *dive;
+	bool fixed_up;
+};
+
+static struct pending_dive *pending_dives;
+static int nr_pending_dives, allocated_pending_dives;
+
+static void parse_dc_job(void *_job)
+{
+	struct dc_job *job = _job;
+
+	for_each_line(job->blob, divecomputer_parser, job->dc);
+}
+
+static void parse_pending_dives(void)
+{
+	int i;
+	struct event *ev;
+
+	parallel_for_each(dc_jobs, nr_dc_jobs, sizeof(struct dc_job), parse_dc_job);
+	for (i = 0; i < nr_dc_jobs; i++) {
+		git_blob_free(dc_jobs[i].blob);
+
+		/* The list of event names isn't safe to update from the parsers */
+		for (ev = dc_jobs[i].dc->events; ev; ev = ev->next)
+			remember_event(ev->name);
+	}
+	nr_dc_jobs = 0;
+	dc_job_bytes = 0;
+
+	for (i = 0; i < nr_pending_dives; i++) {
+		struct dive *dive = pending_dives[i].dive;
+
+		if (pending_dives[i].fixed_up) {
+			add_dive_to_table(dive, &dive_table);
+			remember_dive_details(dive);
+		} else {
+			record_dive(dive);
+		}
+	}
+	nr_pending_dives = 0;
+}
+
+static void queue_pending_dive(struct dive *dive, bool fixed_up)
+{
+	if (nr_pending_dives >= allocated_pending_dives) {
+		allocated_pending_dives = (nr_pending_dives + 32) * 3 / 2;
+		pending_dives = realloc(pending_dives, allocated_pending_dives * sizeof(struct pending_dive));
+		if (!pending_dives)
+			exit(1);
+	}
+	pending_dives[nr_pending_dives].dive = dive;
+	pending_dives[nr_pending_dives].fixed_up = fixed_up;
+	nr_pending_dives++;
+}
+
+static void queue_dc_job(struct divecomputer *dc, git_blob *blob)
+{
+	if (nr_dc_jobs >= allocated_dc_jobs) {
+		allocated_dc_jobs = (nr_dc_jobs + 32) * 3 / 2;
+		dc_jobs = realloc(dc_jobs, allocated_dc_jobs * sizeof(struct dc_job));
+		if (!dc_jobs)
+			exit(1);
+	}
+	dc_jobs[nr_dc_jobs].dc = dc;
+	dc_jobs[nr_dc_jobs].blob = blob;
+	nr_dc_jobs++;
+	dc_job_bytes += git_blob_rawsize(blob);
+}
+
 static void finish_active_dive(void)
 {
 	struct dive *dive = active_dive;
 
 	if (dive) {
 		active_dive = NULL;
-		record_dive(dive);
+		queue_pending_dive(dive, false);
+		if (dc_job_bytes >= DC_BATCH_SIZE)
+			parse_pending_dives();
+	}
+}
+
+/*
+ * When the snapshot of a repository is for an older commit, most
+ * dives in it are usually still the same. A dive directory that
+ * has the same tree id and date as one of the snapshot dives
+ * doesn't need to be parsed again, we just take the old dive.
+ */
+struct old_dive {
+	unsigned char id[20];
+	timestamp_t when;
+	struct dive *dive;
+};
+
+static struct old_dive *old_dives;
+static int nr_old_dives;
+
+/* how many of them the last load took */
+int git_old_dives_used;
+
+static int compare_old_dives(const void *_a, const void *_b)
+{
+	const struct old_dive *a = _a, *b = _b;
+	int cmp = memcmp(a->id, b->id, sizeof(a->id));
+
+	if (cmp)
+		return cmp;
+	return a->when < b->when ? -1 : a->when > b->when;
+}
+
+static void set_old_dives(struct dive_table *table)
+{
+	int i;
+
+	old_dives = malloc(table->nr * sizeof(struct old_dive) + 1);
+	if (!old_dives)
+		exit(1);
+	for (i = 0; i < table->nr; i++) {
+		struct dive *dive = table->dives[i];
+
+		memcpy(old_dives[i].id, dive->git_id, sizeof(old_dives[i].id));
+		old_dives[i].when = dive->when;
+		old_dives[i].dive = dive;
+	}
+	nr_old_dives = table->nr;
+	qsort(old_dives, nr_old_dives, sizeof(struct old_dive), compare_old_dives);
+}
+
+static struct dive *find_old_dive(const git_oid *id, timestamp_t when)
+{
+	struct old_dive key;
+	int lo = 0, hi = nr_old_dives;
+
+	memcpy(key.id, id->id, sizeof(key.id));
+	key.when = when;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (compare_old_dives(old_dives + mid, &key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
+
+	/* Two identical dives at the same time? Take them one by one */
+	for (; lo < nr_old_dives && !compare_old_dives(old_dives + lo, &key); lo++) {
+		struct dive *dive = old_dives[lo].dive;
+
+		if (dive) {
+			old_dives[lo].dive = NULL;
+			return dive;
+		}
+	}
+	return NULL;
+}
+
+static void free_old_dives(void)
+{
+	int i;
+
+	for (i = 0; i < nr_old_dives; i++)
+		free_dive(old_dives[i].dive);
+	free(old_dives);
+	old_dives = NULL;
+	nr_old_dives = 0;
+}
+
+/*
+ * The old dive is already fixed up, so it goes straight into
+ * the table when its batch is done. Its trip comes from the
+ * path like for any other dive, the "notrip" flag comes from
+ * the dive file we didn't look at.
+ */
+static void use_old_dive(struct dive *dive)
+{
+	bool notrip = dive->tripflag == NO_TRIP;
+
+	dive->tripflag = TF_NONE;
+	if (active_trip)
+		add_dive_to_trip(dive, active_trip);
+	if (notrip)
+		dive->tripflag = NO_TRIP;
+
+	queue_pending_dive(dive, true);
+	git_old_dives_used++;
 }
 
 static struct dive *create_new_dive(timestamp_t when)
@@ -1128,12 +1327,14 @@ static int dive_trip_directory(const char *root, const char *name)
  *
  * The root path will be of the form yyyy/mm[/tripdir],
  */
-static int dive_directory(const char *root, const char *name, int timeoff)
+static int dive_directory(const char *root, const char *name, int timeoff, const git_oid *id)
 {
 	int yyyy = -1, mm = -1, dd = -1;
 	int h, m, s;
 	int mday_off, month_off, year_off;
 	struct tm tm;
+	timestamp_t when;
+	struct dive *dive;
 
 	/* Skip the '-' before the time */
 	mday_off = timeoff;
@@ -1205,7 +1406,14 @@ static int dive_directory(const char *root, const char *name, int timeoff)
 	tm.tm_mday = dd;
 
 	finish_active_dive();
-	active_dive = create_new_dive(utc_mktime(&tm));
+	when = utc_mktime(&tm);
+	dive = find_old_dive(id, when);
+	if (dive) {
+		use_old_dive(dive);
+		return GIT_WALK_SKIP;
+	}
+	active_dive = create_new_dive(when);
+	memcpy(active_dive->git_id, id->id, sizeof(active_dive->git_id));
 	return GIT_WALK_OK;
 }
 
@@ -1301,7 +1509,7 @@ static int walk_tree_directory(const char *root, const git_tree_entry *entry)
 	 * two digits and a dash
 	 */
 	if (name[len-3] == ':')
-		return dive_directory(root, name, len-8);
+		return dive_directory(root, name, len-8, git_tree_entry_id(entry));
 
 	if (digits != 2)
 		return GIT_WALK_SKIP;
@@ -1343,18 +1551,23 @@ static struct divecomputer *create_new_dc(struct dive *dive)
  * until necessary, in order to reduce load-time. The parsing is
  * cheap, but the loading of the git blob into memory can be pretty
  * costly.
+ *
+ * For now, we at least leave the parsing to parse_pending_dives().
  */
 static int parse_divecomputer_entry(git_repository *repo, const git_tree_entry *entry, const char *suffix)
 {
 	git_blob *blob = git_tree_entry_blob(repo, entry);
+	struct divecomputer *dc;
 
 	if (!blob)
 		return report_error("Unable to read divecomputer file");
 
-	active_dc = create_new_dc(active_dive);
-	for_each_line(blob, divecomputer_parser, active_dc);
-	git_blob_free(blob);
-	active_dc = NULL;
+	dc = create_new_dc(active_dive);
+	if (!dc) {
+		git_blob_free(blob);
+		return report_error("Unable to allocate divecomputer");
+	}
+	queue_dc_job(dc, blob);
 	return 0;
 }
 
@@ -1510,6 +1723,8 @@ static int do_git_load(git_repository *repo, const char *branch)
 	git_object *object;
 	git_commit *commit;
 	git_tree *tree;
+	char id[GIT_OID_HEXSZ + 1];
+	char *snapshot = NULL;
 
 	if (git_revparse_single(&object, repo, branch))
 		return report_error("Unable to look up revision '%s'", branch);
@@ -1517,7 +1732,31 @@ static int do_git_load(git_repository *repo, const char *branch)
 		return report_error("Revision '%s' is not a valid commit", branch);
 	if (git_commit_tree(&tree, commit))
 		return report_error("Could not look up tree of commit in branch '%s'", branch);
-	ret = load_dives_from_tree(repo, tree);
+
+	git_old_dives_used = 0;
+	/* A snapshot of this very commit saves us walking the whole tree */
+	git_oid_tostr(id, sizeof(id), git_commit_id(commit));
+	if (snapshot_applies())
+		snapshot = git_snapshot_name(repo);
+	if (snapshot && !load_snapshot(snapshot, id)) {
+		ret = 0;
+	} else {
+		/* A snapshot of an older commit still has most of the dives */
+		struct dive_table old_table = { 0 };
+
+		if (snapshot && !load_snapshot_dives(snapshot, &old_table))
+			set_old_dives(&old_table);
+		free(old_table.dives);
+
+		ret = load_dives_from_tree(repo, tree);
+		finish_active_dive();
+		finish_active_trip();
+		parse_pending_dives();
+		free_old_dives();
+		if (!ret && snapshot)
+			save_snapshot(snapshot, id);
+	}
+	free(snapshot);
 	if (!ret)
 		set_git_id(git_commit_id(commit));
 	git_object_free((git_object *)tree);
@@ -1543,5 +1782,6 @@ int git_load_dives(struct git_repository *repo, const char *branch)
 	free((void *)branch);
 	finish_active_dive();
 	finish_active_trip();
+	parse_pending_dives();
 	return ret;
 }
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stddef.h>
 #include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
@@ -10,12 +11,14 @@
 #include <libxml/parser.h>
 #include <libxml/parserInternals.h>
 #include <libxml/tree.h>
+#include <libxml/xmlreader.h>
 #include <libxslt/transform.h>
 #include <libdivecomputer/parser.h>
 
 #include "gettext.h"
 
 #include "dive.h"
+#include "divelist.h"
 #include "device.h"
 #include "membuffer.h"
 
@@ -26,6 +29,7 @@ bool abort_read_of_old_file = false;
 bool v2_question_shown = false;
 
 static xmlDoc *test_xslt_transforms(xmlDoc *doc, const char **params);
+static bool needs_xslt_transform(xmlNode *root_element);
 
 /* the dive table holds the overall dive list; target table points at
  * the table we are currently filling */
@@ -62,9 +66,9 @@ void clear_table(struct dive_table *table)
 }
 
 /*
- * Add a dive into the dive_table array
+ * Add a dive into the dive_table array, as it is
  */
-void record_dive_to_table(struct dive *dive, struct dive_table *table)
+void add_dive_to_table(struct dive *dive, struct dive_table *table)
 {
 	assert(table != NULL);
 	int nr = table->nr, allocated = table->allocated;
@@ -78,10 +82,18 @@ void record_dive_to_table(struct dive *dive, struct dive_table *table)
 		table->dives = dives;
 		table->allocated = allocated;
 	}
-	dives[nr] = fixup_dive(dive);
+	dives[nr] = dive;
 	table->nr = nr + 1;
 }
 
+/*
+ * Add a dive we just parsed into the dive_table array
+ */
+void record_dive_to_table(struct dive *dive, struct dive_table *table)
+{
+	add_dive_to_table(fixup_dive(dive), table);
+}
+
 void record_dive(struct dive *dive)
 {
 	record_dive_to_table(dive, &dive_table);
@@ -126,34 +138,47 @@ const struct units SI_units = SI_UNITS;
 const struct units IMPERIAL_units = IMPERIAL_UNITS;
 
 /*
- * Dive info as it is being built up..
+ * Dive info as it is being built up.. All of what the parser keeps
+ * track of while walking a document is in 'state', the tables it
+ * fills aside.
  */
 #define MAX_EVENT_NAME 128
-static struct divecomputer *cur_dc;
-static struct dive *cur_dive;
-static struct dive_site *cur_dive_site;
-static dive_trip_t *cur_trip = NULL;
-static struct sample *cur_sample;
-static struct picture *cur_picture;
-static union {
-	struct event event;
-	char allocation[sizeof(struct event)+MAX_EVENT_NAME];
-} event_allocation = { .event.deleted = 1 };
-#define cur_event event_allocation.event
-static struct {
+enum import_source {
+	UNKNOWN,
+	LIBDIVECOMPUTER,
+	DIVINGLOG,
+	UDDF,
+};
+
+static struct parser_state {
+	struct divecomputer *cur_dc;
+	struct dive *cur_dive;
+	struct dive_site *cur_dive_site;
+	dive_trip_t *cur_trip;
+	struct sample *cur_sample;
+	struct picture *cur_picture;
+	union {
+		struct event event;
+		char allocation[sizeof(struct event)+MAX_EVENT_NAME];
+	} event_allocation;
 	struct {
-		const char *model;
-		uint32_t deviceid;
-		const char *nickname, *serial_nr, *firmware;
-	} dc;
-} cur_settings;
-static bool in_settings = false;
-static bool in_userid = false;
-static struct tm cur_tm;
-static int cur_cylinder_index, cur_ws_index;
-static int lastndl, laststoptime, laststopdepth, lastcns, lastpo2, lastindeco;
-static int lastcylinderindex, lastsensor;
-static struct extra_data cur_extra_data;
+		struct {
+			const char *model;
+			uint32_t deviceid;
+			const char *nickname, *serial_nr, *firmware;
+		} dc;
+	} cur_settings;
+	bool in_settings;
+	bool in_userid;
+	struct tm cur_tm;
+	int cur_cylinder_index, cur_ws_index;
+	int lastndl, laststoptime, laststopdepth, lastcns, lastpo2, lastindeco;
+	int lastcylinderindex, lastsensor;
+	struct extra_data cur_extra_data;
+	enum import_source import_source;
+	const char *country, *city;
+} state = { .event_allocation.event.deleted = 1 };
+#define cur_event state.event_allocation.event
 
 /*
  * If we don't have an explicit dive computer,
@@ -161,15 +186,9 @@ static struct extra_data cur_extra_data;
  */
 static struct divecomputer *get_dc(void)
 {
-	return cur_dc ?: &cur_dive->dc;
+	return state.cur_dc ?: &state.cur_dive->dc;
 }
 
-static enum import_source {
-	UNKNOWN,
-	LIBDIVECOMPUTER,
-	DIVINGLOG,
-	UDDF,
-} import_source;
 
 static void divedate(const char *buffer, timestamp_t *when)
 {
@@ -187,14 +206,14 @@ static void divedate(const char *buffer, timestamp_t *when)
 		fprintf(stderr, "Unable to parse date '%s'\n", buffer);
 		return;
 	}
-	cur_tm.tm_year = y;
-	cur_tm.tm_mon = m - 1;
-	cur_tm.tm_mday = d;
-	cur_tm.tm_hour = hh;
-	cur_tm.tm_min = mm;
-	cur_tm.tm_sec = ss;
+	state.cur_tm.tm_year = y;
+	state.cur_tm.tm_mon = m - 1;
+	state.cur_tm.tm_mday = d;
+	state.cur_tm.tm_hour = hh;
+	state.cur_tm.tm_min = mm;
+	state.cur_tm.tm_sec = ss;
 
-	*when = utc_mktime(&cur_tm);
+	*when = utc_mktime(&state.cur_tm);
 }
 
 static void divetime(const char *buffer, timestamp_t *when)
@@ -202,10 +221,10 @@ static void divetime(const char *buffer, timestamp_t *when)
 	int h, m, s = 0;
 
 	if (sscanf(buffer, "%d:%d:%d", &h, &m, &s) >= 2) {
-		cur_tm.tm_hour = h;
-		cur_tm.tm_min = m;
-		cur_tm.tm_sec = s;
-		*when = utc_mktime(&cur_tm);
+		state.cur_tm.tm_hour = h;
+		state.cur_tm.tm_min = m;
+		state.cur_tm.tm_sec = s;
+		*when = utc_mktime(&state.cur_tm);
 	}
 }
 
@@ -217,13 +236,13 @@ static void divedatetime(char *buffer, timestamp_t *when)
 
 	if (sscanf(buffer, "%d-%d-%d %d:%d:%d",
 		   &y, &m, &d, &hr, &min, &sec) == 6) {
-		cur_tm.tm_year = y;
-		cur_tm.tm_mon = m - 1;
-		cur_tm.tm_mday = d;
-		cur_tm.tm_hour = hr;
-		cur_tm.tm_min = min;
-		cur_tm.tm_sec = sec;
-		*when = utc_mktime(&cur_tm);
+		state.cur_tm.tm_year = y;
+		state.cur_tm.tm_mon = m - 1;
+		state.cur_tm.tm_mday = d;
+		state.cur_tm.tm_hour = hr;
+		state.cur_tm.tm_min = min;
+		state.cur_tm.tm_sec = sec;
+		*when = utc_mktime(&state.cur_tm);
 	}
 }
 
@@ -390,14 +409,14 @@ static void depth(char *buffer, depth_t *depth)
 
 static void extra_data_start(void)
 {
-	memset(&cur_extra_data, 0, sizeof(struct extra_data));
+	memset(&state.cur_extra_data, 0, sizeof(struct extra_data));
 }
 
 static void extra_data_end(void)
 {
 	// don't save partial structures - we must have both key and value
-	if (cur_extra_data.key && cur_extra_data.value)
-		add_extra_data(cur_dc, cur_extra_data.key, cur_extra_data.value);
+	if (state.cur_extra_data.key && state.cur_extra_data.value)
+		add_extra_data(state.cur_dc, state.cur_extra_data.key, state.cur_extra_data.value);
 }
 
 static void weight(char *buffer, weight_t *weight)
@@ -527,7 +546,7 @@ static void gasmix(char *buffer, fraction_t *fraction)
 	/* libdivecomputer does negative percentages. */
 	if (*buffer == '-')
 		return;
-	if (cur_cylinder_index < MAX_CYLINDERS)
+	if (state.cur_cylinder_index < MAX_CYLINDERS)
 		percent(buffer, fraction);
 }
 
@@ -585,6 +604,96 @@ static void get_dc_type(char *buffer, enum dive_comp_type *dct)
 	if (0) (fn)("test", dest);			\
 	match(pattern, strlen(pattern), name, (matchfn_t) (fn), buf, dest); })
 
+/*
+ * Going down a chain of MATCH() calls is too slow for the attributes of
+ * the samples, of which a large divelog has millions. A match table
+ * looks the name up in a hash of its patterns instead and finds the same
+ * entry the chain would: a pattern matches the first one or the first
+ * two components of the name, and the earlier of those entries wins.
+ * The fields are given as offsets into the structure passed to
+ * match_table().
+ */
+struct match_entry {
+	const char *pattern;
+	matchfn_t fn;
+	size_t offset;
+};
+
+#define MATCH_ENTRY(pattern, fn, type, field) \
+	/* Same silly type compatibility test */ \
+	{ pattern, (matchfn_t) (fn), offsetof(type, field) + 0 * sizeof((fn)("test", &((type *)0)->field), 0) }
+
+/* a power of two, and more than twice the entries of any table */
+#define MATCH_HASH_SIZE 64
+
+struct match_table {
+	const struct match_entry *entries;
+	int nr;
+	bool hashed;
+	signed char hash[MATCH_HASH_SIZE];	/* index + 1 of the entry, zero if empty */
+};
+
+static unsigned int match_hash(const char *s, int len)
+{
+	unsigned int hash = 0;
+
+	while (--len >= 0)
+		hash = hash * 31 + (unsigned char)*s++;
+	return hash;
+}
+
+static void hash_match_table(struct match_table *table)
+{
+	int i;
+
+	for (i = 0; i < table->nr; i++) {
+		const char *pattern = table->entries[i].pattern;
+		unsigned int hash = match_hash(pattern, strlen(pattern));
+
+		while (table->hash[hash % MATCH_HASH_SIZE])
+			hash++;
+		table->hash[hash % MATCH_HASH_SIZE] = i + 1;
+	}
+	table->hashed = true;
+}
+
+/* the entry with a pattern of exactly these len characters, -1 if there is none */
+static int find_match_entry(const struct match_table *table, const char *name, int len)
+{
+	unsigned int hash = match_hash(name, len);
+	int i;
+
+	while ((i = table->hash[hash % MATCH_HASH_SIZE]) != 0) {
+		const char *pattern = table->entries[i - 1].pattern;
+		if (!strncmp(pattern, name, len) && !pattern[len])
+			return i - 1;
+		hash++;
+	}
+	return -1;
+}
+
+static int match_table(struct match_table *table, const char *name, char *buf, void *base)
+{
+	const char *dot = strchr(name, '.');
+	int i, both = -1;
+
+	if (!table->hashed)
+		hash_match_table(table);
+	if (dot) {
+		const char *end = strchr(dot + 1, '.');
+		both = find_match_entry(table, name, end ? end - name : strlen(name));
+		i = find_match_entry(table, name, dot - name);
+		if (both >= 0 && (i < 0 || both < i))
+			i = both;
+	} else {
+		i = find_match_entry(table, name, strlen(name));
+	}
+	if (i < 0)
+		return 0;
+	table->entries[i].fn(buf, (char *)base + table->entries[i].offset);
+	return 1;
+}
+
 static void get_index(char *buffer, int *i)
 {
 	*i = atoi(buffer);
@@ -713,7 +822,7 @@ static void uddf_gasswitch(char *buffer, struct sample *sample)
 {
 	int idx = atoi(buffer);
 	int seconds = sample->time.seconds;
-	struct dive *dive = cur_dive;
+	struct dive *dive = state.cur_dive;
 	struct divecomputer *dc = get_dc();
 
 	add_gas_switch_event(dive, dc, seconds, idx);
@@ -732,8 +841,8 @@ static int uddf_fill_sample(struct sample *sample, const char *name, char *buf)
 static void eventtime(char *buffer, duration_t *duration)
 {
 	sampletime(buffer, duration);
-	if (cur_sample)
-		duration->seconds += cur_sample->time.seconds;
+	if (state.cur_sample)
+		duration->seconds += state.cur_sample->time.seconds;
 }
 
 static void try_to_match_autogroup(const char *name, char *buf)
@@ -771,30 +880,30 @@ void add_gas_switch_event(struct dive *dive, struct divecomputer *dc, int second
 static void get_cylinderindex(char *buffer, uint8_t *i)
 {
 	*i = atoi(buffer);
-	if (lastcylinderindex != *i) {
-		add_gas_switch_event(cur_dive, get_dc(), cur_sample->time.seconds, *i);
-		lastcylinderindex = *i;
+	if (state.lastcylinderindex != *i) {
+		add_gas_switch_event(state.cur_dive, get_dc(), state.cur_sample->time.seconds, *i);
+		state.lastcylinderindex = *i;
 	}
 }
 
 static void get_sensor(char *buffer, uint8_t *i)
 {
 	*i = atoi(buffer);
-	lastsensor = *i;
+	state.lastsensor = *i;
 }
 
 static void try_to_fill_dc_settings(const char *name, char *buf)
 {
 	start_match("divecomputerid", name, buf);
-	if (MATCH("model.divecomputerid", utf8_string, &cur_settings.dc.model))
+	if (MATCH("model.divecomputerid", utf8_string, &state.cur_settings.dc.model))
 		return;
-	if (MATCH("deviceid.divecomputerid", hex_value, &cur_settings.dc.deviceid))
+	if (MATCH("deviceid.divecomputerid", hex_value, &state.cur_settings.dc.deviceid))
 		return;
-	if (MATCH("nickname.divecomputerid", utf8_string, &cur_settings.dc.nickname))
+	if (MATCH("nickname.divecomputerid", utf8_string, &state.cur_settings.dc.nickname))
 		return;
-	if (MATCH("serial.divecomputerid", utf8_string, &cur_settings.dc.serial_nr))
+	if (MATCH("serial.divecomputerid", utf8_string, &state.cur_settings.dc.serial_nr))
 		return;
-	if (MATCH("firmware.divecomputerid", utf8_string, &cur_settings.dc.firmware))
+	if (MATCH("firmware.divecomputerid", utf8_string, &state.cur_settings.dc.firmware))
 		return;
 
 	nonmatch("divecomputerid", name, buf);
@@ -857,9 +966,9 @@ static int match_dc_data_fields(struct divecomputer *dc, const char *name, char
 		return 1;
 	if (MATCH("salinity.water", salinity, &dc->salinity))
 		return 1;
-	if (MATCH("key.extradata", utf8_string, &cur_extra_data.key))
+	if (MATCH("key.extradata", utf8_string, &state.cur_extra_data.key))
 		return 1;
-	if (MATCH("value.extradata", utf8_string, &cur_extra_data.value))
+	if (MATCH("value.extradata", utf8_string, &state.cur_extra_data.value))
 		return 1;
 	return 0;
 }
@@ -889,62 +998,47 @@ static void try_to_fill_dc(struct divecomputer *dc, const char *name, char *buf)
 	nonmatch("divecomputer", name, buf);
 }
 
+static void get_in_deco(char *buffer, bool *in_deco)
+{
+	*in_deco = atoi(buffer) == 1;
+}
+
+static const struct match_entry sample_fields[] = {
+	MATCH_ENTRY("pressure.sample", pressure, struct sample, cylinderpressure),
+	MATCH_ENTRY("cylpress.sample", pressure, struct sample, cylinderpressure),
+	MATCH_ENTRY("pdiluent.sample", pressure, struct sample, cylinderpressure),
+	MATCH_ENTRY("o2pressure.sample", pressure, struct sample, o2cylinderpressure),
+	MATCH_ENTRY("cylinderindex.sample", get_cylinderindex, struct sample, sensor),
+	MATCH_ENTRY("sensor.sample", get_sensor, struct sample, sensor),
+	MATCH_ENTRY("depth.sample", depth, struct sample, depth),
+	MATCH_ENTRY("temp.sample", temperature, struct sample, temperature),
+	MATCH_ENTRY("temperature.sample", temperature, struct sample, temperature),
+	MATCH_ENTRY("sampletime.sample", sampletime, struct sample, time),
+	MATCH_ENTRY("time.sample", sampletime, struct sample, time),
+	MATCH_ENTRY("ndl.sample", sampletime, struct sample, ndl),
+	MATCH_ENTRY("tts.sample", sampletime, struct sample, tts),
+	MATCH_ENTRY("in_deco.sample", get_in_deco, struct sample, in_deco),
+	MATCH_ENTRY("stoptime.sample", sampletime, struct sample, stoptime),
+	MATCH_ENTRY("stopdepth.sample", depth, struct sample, stopdepth),
+	MATCH_ENTRY("cns.sample", get_uint8, struct sample, cns),
+	MATCH_ENTRY("sensor1.sample", double_to_o2pressure, struct sample, o2sensor[0]), // CCR O2 sensor data
+	MATCH_ENTRY("sensor2.sample", double_to_o2pressure, struct sample, o2sensor[1]),
+	MATCH_ENTRY("sensor3.sample", double_to_o2pressure, struct sample, o2sensor[2]), // up to 3 CCR sensors
+	MATCH_ENTRY("po2.sample", double_to_o2pressure, struct sample, setpoint),
+	MATCH_ENTRY("heartbeat", get_uint8, struct sample, heartbeat),
+	MATCH_ENTRY("bearing", get_bearing, struct sample, bearing),
+};
+
+static struct match_table sample_table = { sample_fields, sizeof(sample_fields) / sizeof(sample_fields[0]) };
+
 /* We're in samples - try to convert the random xml value to something useful */
 static void try_to_fill_sample(struct sample *sample, const char *name, char *buf)
 {
-	int in_deco;
-
 	start_match("sample", name, buf);
-	if (MATCH("pressure.sample", pressure, &sample->cylinderpressure))
-		return;
-	if (MATCH("cylpress.sample", pressure, &sample->cylinderpressure))
-		return;
-	if (MATCH("pdiluent.sample", pressure, &sample->cylinderpressure))
-		return;
-	if (MATCH("o2pressure.sample", pressure, &sample->o2cylinderpressure))
-		return;
-	if (MATCH("cylinderindex.sample", get_cylinderindex, &sample->sensor))
-		return;
-	if (MATCH("sensor.sample", get_sensor, &sample->sensor))
-		return;
-	if (MATCH("depth.sample", depth, &sample->depth))
-		return;
-	if (MATCH("temp.sample", temperature, &sample->temperature))
-		return;
-	if (MATCH("temperature.sample", temperature, &sample->temperature))
-		return;
-	if (MATCH("sampletime.sample", sampletime, &sample->time))
-		return;
-	if (MATCH("time.sample", sampletime, &sample->time))
-		return;
-	if (MATCH("ndl.sample", sampletime, &sample->ndl))
-		return;
-	if (MATCH("tts.sample", sampletime, &sample->tts))
-		return;
-	if (MATCH("in_deco.sample", get_index, &in_deco)) {
-		sample->in_deco = (in_deco == 1);
-		return;
-	}
-	if (MATCH("stoptime.sample", sampletime, &sample->stoptime))
-		return;
-	if (MATCH("stopdepth.sample", depth, &sample->stopdepth))
-		return;
-	if (MATCH("cns.sample", get_uint8, &sample->cns))
-		return;
-	if (MATCH("sensor1.sample", double_to_o2pressure, &sample->o2sensor[0])) // CCR O2 sensor data
-		return;
-	if (MATCH("sensor2.sample", double_to_o2pressure, &sample->o2sensor[1]))
-		return;
-	if (MATCH("sensor3.sample", double_to_o2pressure, &sample->o2sensor[2])) // up to 3 CCR sensors
-		return;
-	if (MATCH("po2.sample", double_to_o2pressure, &sample->setpoint))
-		return;
-	if (MATCH("heartbeat", get_uint8, &sample->heartbeat))
-		return;
-	if (MATCH("bearing", get_bearing, &sample->bearing))
+	if (match_table(&sample_table, name, buf, sample))
 		return;
 
-	switch (import_source) {
+	switch (state.import_source) {
 	case DIVINGLOG:
 		if (divinglog_fill_sample(sample, name, buf))
 			return;
@@ -968,8 +1062,6 @@ void try_to_fill_userid(const char *name, char *buf)
 		set_userid(buf);
 }
 
-static const char *country, *city;
-
 static void divinglog_place(char *place, uint32_t *uuid)
 {
 	char buffer[1024];
@@ -977,16 +1069,16 @@ static void divinglog_place(char *place, uint32_t *uuid)
 	snprintf(buffer, sizeof(buffer),
 		 "%s%s%s%s%s",
 		 place,
-		 city ? ", " : "",
-		 city ? city : "",
-		 country ? ", " : "",
-		 country ? country : "");
+		 state.city ? ", " : "",
+		 state.city ? state.city : "",
+		 state.country ? ", " : "",
+		 state.country ? state.country : "");
 	*uuid = get_dive_site_uuid_by_name(buffer, NULL);
 	if (*uuid == 0)
 		*uuid = create_dive_site(buffer);
 
-	city = NULL;
-	country = NULL;
+	state.city = NULL;
+	state.country = NULL;
 }
 
 static int divinglog_dive_match(struct dive *dive, const char *name, char *buf)
@@ -1003,8 +1095,8 @@ static int divinglog_dive_match(struct dive *dive, const char *name, char *buf)
 	       MATCH("prese", pressure, &dive->cylinder[0].end) ||
 	       MATCH("comments", utf8_string, &dive->notes) ||
 	       MATCH("names.buddy", utf8_string, &dive->buddy) ||
-	       MATCH("name.country", utf8_string, &country) ||
-	       MATCH("name.city", utf8_string, &city) ||
+	       MATCH("name.country", utf8_string, &state.country) ||
+	       MATCH("name.city", utf8_string, &state.city) ||
 	       MATCH("name.place", divinglog_place, &dive->dive_site_uuid) ||
 	       0;
 }
@@ -1053,8 +1145,8 @@ success:
 #define uddf_datedata(name, offset)                              \
 	static void uddf_##name(char *buffer, timestamp_t *when) \
 	{                                                        \
-		cur_tm.tm_##name = atoi(buffer) + offset;        \
-		*when = utc_mktime(&cur_tm);                     \
+		state.cur_tm.tm_##name = atoi(buffer) + offset;        \
+		*when = utc_mktime(&state.cur_tm);                     \
 	}
 
 uddf_datedata(year, 0)
@@ -1255,7 +1347,7 @@ static void try_to_fill_dive(struct dive *dive, const char *name, char *buf)
 {
 	start_match("dive", name, buf);
 
-	switch (import_source) {
+	switch (state.import_source) {
 	case DIVINGLOG:
 		if (divinglog_dive_match(dive, name, buf))
 			return;
@@ -1290,13 +1382,13 @@ static void try_to_fill_dive(struct dive *dive, const char *name, char *buf)
 	if (match_dc_data_fields(&dive->dc, name, buf))
 		return;
 
-	if (MATCH("filename.picture", utf8_string, &cur_picture->filename))
+	if (MATCH("filename.picture", utf8_string, &state.cur_picture->filename))
 		return;
-	if (MATCH("offset.picture", offsettime, &cur_picture->offset))
+	if (MATCH("offset.picture", offsettime, &state.cur_picture->offset))
 		return;
-	if (MATCH("gps.picture", gps_picture_location, cur_picture))
+	if (MATCH("gps.picture", gps_picture_location, state.cur_picture))
 		return;
-	if (MATCH("hash.picture", utf8_string, &cur_picture->hash))
+	if (MATCH("hash.picture", utf8_string, &state.cur_picture->hash))
 		return;
 	if (MATCH("cylinderstartpressure", pressure, &dive->cylinder[0].start))
 		return;
@@ -1336,31 +1428,31 @@ static void try_to_fill_dive(struct dive *dive, const char *name, char *buf)
 		return;
 	if (MATCH("visibility.dive", get_rating, &dive->visibility))
 		return;
-	if (MATCH("size.cylinder", cylindersize, &dive->cylinder[cur_cylinder_index].type.size))
+	if (MATCH("size.cylinder", cylindersize, &dive->cylinder[state.cur_cylinder_index].type.size))
 		return;
-	if (MATCH("workpressure.cylinder", pressure, &dive->cylinder[cur_cylinder_index].type.workingpressure))
+	if (MATCH("workpressure.cylinder", pressure, &dive->cylinder[state.cur_cylinder_index].type.workingpressure))
 		return;
-	if (MATCH("description.cylinder", utf8_string, &dive->cylinder[cur_cylinder_index].type.description))
+	if (MATCH("description.cylinder", utf8_string, &dive->cylinder[state.cur_cylinder_index].type.description))
 		return;
-	if (MATCH("start.cylinder", pressure, &dive->cylinder[cur_cylinder_index].start))
+	if (MATCH("start.cylinder", pressure, &dive->cylinder[state.cur_cylinder_index].start))
 		return;
-	if (MATCH("end.cylinder", pressure, &dive->cylinder[cur_cylinder_index].end))
+	if (MATCH("end.cylinder", pressure, &dive->cylinder[state.cur_cylinder_index].end))
 		return;
-	if (MATCH("use.cylinder", cylinder_use, &dive->cylinder[cur_cylinder_index].cylinder_use))
+	if (MATCH("use.cylinder", cylinder_use, &dive->cylinder[state.cur_cylinder_index].cylinder_use))
 		return;
-	if (MATCH("description.weightsystem", utf8_string, &dive->weightsystem[cur_ws_index].description))
+	if (MATCH("description.weightsystem", utf8_string, &dive->weightsystem[state.cur_ws_index].description))
 		return;
-	if (MATCH("weight.weightsystem", weight, &dive->weightsystem[cur_ws_index].weight))
+	if (MATCH("weight.weightsystem", weight, &dive->weightsystem[state.cur_ws_index].weight))
 		return;
-	if (MATCH("weight", weight, &dive->weightsystem[cur_ws_index].weight))
+	if (MATCH("weight", weight, &dive->weightsystem[state.cur_ws_index].weight))
 		return;
-	if (MATCH("o2", gasmix, &dive->cylinder[cur_cylinder_index].gasmix.o2))
+	if (MATCH("o2", gasmix, &dive->cylinder[state.cur_cylinder_index].gasmix.o2))
 		return;
-	if (MATCH("o2percent", gasmix, &dive->cylinder[cur_cylinder_index].gasmix.o2))
+	if (MATCH("o2percent", gasmix, &dive->cylinder[state.cur_cylinder_index].gasmix.o2))
 		return;
-	if (MATCH("n2", gasmix_nitrogen, &dive->cylinder[cur_cylinder_index].gasmix))
+	if (MATCH("n2", gasmix_nitrogen, &dive->cylinder[state.cur_cylinder_index].gasmix))
 		return;
-	if (MATCH("he", gasmix, &dive->cylinder[cur_cylinder_index].gasmix.he))
+	if (MATCH("he", gasmix, &dive->cylinder[state.cur_cylinder_index].gasmix.he))
 		return;
 	if (MATCH("air.divetemperature", temperature, &dive->airtemp))
 		return;
@@ -1424,37 +1516,37 @@ static void try_to_fill_dive_site(struct dive_site **ds_p, const char *name, cha
  */
 static bool is_dive(void)
 {
-	return (cur_dive &&
-		(cur_dive->dive_site_uuid || cur_dive->when || cur_dive->dc.samples));
+	return (state.cur_dive &&
+		(state.cur_dive->dive_site_uuid || state.cur_dive->when || state.cur_dive->dc.samples));
 }
 
 static void reset_dc_info(struct divecomputer *dc)
 {
-	lastcns = lastpo2 = lastndl = laststoptime = laststopdepth = lastindeco = 0;
-	lastsensor = lastcylinderindex = 0;
+	state.lastcns = state.lastpo2 = state.lastndl = state.laststoptime = state.laststopdepth = state.lastindeco = 0;
+	state.lastsensor = state.lastcylinderindex = 0;
 }
 
 static void reset_dc_settings(void)
 {
-	free((void *)cur_settings.dc.model);
-	free((void *)cur_settings.dc.nickname);
-	free((void *)cur_settings.dc.serial_nr);
-	free((void *)cur_settings.dc.firmware);
-	cur_settings.dc.model = NULL;
-	cur_settings.dc.nickname = NULL;
-	cur_settings.dc.serial_nr = NULL;
-	cur_settings.dc.firmware = NULL;
-	cur_settings.dc.deviceid = 0;
+	free((void *)state.cur_settings.dc.model);
+	free((void *)state.cur_settings.dc.nickname);
+	free((void *)state.cur_settings.dc.serial_nr);
+	free((void *)state.cur_settings.dc.firmware);
+	state.cur_settings.dc.model = NULL;
+	state.cur_settings.dc.nickname = NULL;
+	state.cur_settings.dc.serial_nr = NULL;
+	state.cur_settings.dc.firmware = NULL;
+	state.cur_settings.dc.deviceid = 0;
 }
 
 static void settings_start(void)
 {
-	in_settings = true;
+	state.in_settings = true;
 }
 
 static void settings_end(void)
 {
-	in_settings = false;
+	state.in_settings = false;
 }
 
 static void dc_settings_start(void)
@@ -1464,79 +1556,79 @@ static void dc_settings_start(void)
 
 static void dc_settings_end(void)
 {
-	create_device_node(cur_settings.dc.model, cur_settings.dc.deviceid, cur_settings.dc.serial_nr,
-			   cur_settings.dc.firmware, cur_settings.dc.nickname);
+	create_device_node(state.cur_settings.dc.model, state.cur_settings.dc.deviceid, state.cur_settings.dc.serial_nr,
+			   state.cur_settings.dc.firmware, state.cur_settings.dc.nickname);
 	reset_dc_settings();
 }
 
 static void dive_site_start(void)
 {
-	if (cur_dive_site)
+	if (state.cur_dive_site)
 		return;
-	cur_dive_site = calloc(1, sizeof(struct dive_site));
+	state.cur_dive_site = calloc(1, sizeof(struct dive_site));
 }
 
 static void dive_site_end(void)
 {
-	if (!cur_dive_site)
+	if (!state.cur_dive_site)
 		return;
-	if (cur_dive_site->uuid) {
-		uint32_t tmp = create_dive_site_with_gps(cur_dive_site->name, cur_dive_site->latitude, cur_dive_site->longitude);
+	if (state.cur_dive_site->uuid) {
+		uint32_t tmp = create_dive_site_with_gps(state.cur_dive_site->name, state.cur_dive_site->latitude, state.cur_dive_site->longitude);
 		struct dive_site *ds = get_dive_site_by_uuid(tmp);
-		ds->uuid = cur_dive_site->uuid;
-		ds->notes = cur_dive_site->notes;
-		ds->description = cur_dive_site->description;
+		ds->uuid = state.cur_dive_site->uuid;
+		ds->notes = state.cur_dive_site->notes;
+		ds->description = state.cur_dive_site->description;
 		if (verbose > 3)
 			printf("completed dive site uuid %x8 name {%s}\n", ds->uuid, ds->name);
 	}
-	free(cur_dive_site);
-	cur_dive_site = NULL;
+	free(state.cur_dive_site);
+	state.cur_dive_site = NULL;
 }
 
 // now we need to add the code to parse the parts of the divesite enry
 
 static void dive_start(void)
 {
-	if (cur_dive)
+	if (state.cur_dive)
 		return;
-	cur_dive = alloc_dive();
-	reset_dc_info(&cur_dive->dc);
-	memset(&cur_tm, 0, sizeof(cur_tm));
-	if (cur_trip) {
-		add_dive_to_trip(cur_dive, cur_trip);
-		cur_dive->tripflag = IN_TRIP;
+	state.cur_dive = alloc_dive();
+	reset_dc_info(&state.cur_dive->dc);
+	memset(&state.cur_tm, 0, sizeof(state.cur_tm));
+	if (state.cur_trip) {
+		add_dive_to_trip(state.cur_dive, state.cur_trip);
+		state.cur_dive->tripflag = IN_TRIP;
 	}
 }
 
 static void dive_end(void)
 {
-	if (!cur_dive)
+	if (!state.cur_dive)
 		return;
 	if (!is_dive())
-		free(cur_dive);
+		free(state.cur_dive);
 	else
-		record_dive_to_table(cur_dive, target_table);
-	cur_dive = NULL;
-	cur_dc = NULL;
-	cur_cylinder_index = 0;
-	cur_ws_index = 0;
+		record_dive_to_table(state.cur_dive, target_table);
+	state.cur_dive = NULL;
+	state.cur_dc = NULL;
+	state.cur_cylinder_index = 0;
+	state.cur_ws_index = 0;
 }
 
 static void trip_start(void)
 {
-	if (cur_trip)
+	if (state.cur_trip)
 		return;
 	dive_end();
-	cur_trip = calloc(1, sizeof(dive_trip_t));
-	memset(&cur_tm, 0, sizeof(cur_tm));
+	state.cur_trip = calloc(1, sizeof(dive_trip_t));
+	memset(&state.cur_tm, 0, sizeof(state.cur_tm));
 }
 
 static void trip_end(void)
 {
-	if (!cur_trip)
+	if (!state.cur_trip)
 		return;
-	insert_trip(&cur_trip);
-	cur_trip = NULL;
+	insert_trip(&state.cur_trip);
+	state.cur_trip = NULL;
 }
 
 static void event_start(void)
@@ -1554,7 +1646,7 @@ static void event_end(void)
 			pic->filename = strdup(cur_event.name);
 			/* theoretically this could fail - but we didn't support multi year offsets */
 			pic->offset.seconds = cur_event.time.seconds;
-			dive_add_picture(cur_dive, pic);
+			dive_add_picture(state.cur_dive, pic);
 		} else {
 			struct event *ev;
 			/* At some point gas change events did not have any type. Thus we need to add
@@ -1578,13 +1670,13 @@ static void event_end(void)
 
 static void picture_start(void)
 {
-	cur_picture = alloc_picture();
+	state.cur_picture = alloc_picture();
 }
 
 static void picture_end(void)
 {
-	dive_add_picture(cur_dive, cur_picture);
-	cur_picture = NULL;
+	dive_add_picture(state.cur_dive, state.cur_picture);
+	state.cur_picture = NULL;
 }
 
 static void cylinder_start(void)
@@ -1593,7 +1685,7 @@ static void cylinder_start(void)
 
 static void cylinder_end(void)
 {
-	cur_cylinder_index++;
+	state.cur_cylinder_index++;
 }
 
 static void ws_start(void)
@@ -1602,34 +1694,34 @@ static void ws_start(void)
 
 static void ws_end(void)
 {
-	cur_ws_index++;
+	state.cur_ws_index++;
 }
 
 static void sample_start(void)
 {
-	cur_sample = prepare_sample(get_dc());
-	cur_sample->ndl.seconds = lastndl;
-	cur_sample->in_deco = lastindeco;
-	cur_sample->stoptime.seconds = laststoptime;
-	cur_sample->stopdepth.mm = laststopdepth;
-	cur_sample->cns = lastcns;
-	cur_sample->setpoint.mbar = lastpo2;
-	cur_sample->sensor = lastsensor;
+	state.cur_sample = prepare_sample(get_dc());
+	state.cur_sample->ndl.seconds = state.lastndl;
+	state.cur_sample->in_deco = state.lastindeco;
+	state.cur_sample->stoptime.seconds = state.laststoptime;
+	state.cur_sample->stopdepth.mm = state.laststopdepth;
+	state.cur_sample->cns = state.lastcns;
+	state.cur_sample->setpoint.mbar = state.lastpo2;
+	state.cur_sample->sensor = state.lastsensor;
 }
 
 static void sample_end(void)
 {
-	if (!cur_dive)
+	if (!state.cur_dive)
 		return;
 
 	finish_sample(get_dc());
-	lastndl = cur_sample->ndl.seconds;
-	lastindeco = cur_sample->in_deco;
-	laststoptime = cur_sample->stoptime.seconds;
-	laststopdepth = cur_sample->stopdepth.mm;
-	lastcns = cur_sample->cns;
-	lastpo2 = cur_sample->setpoint.mbar;
-	cur_sample = NULL;
+	state.lastndl = state.cur_sample->ndl.seconds;
+	state.lastindeco = state.cur_sample->in_deco;
+	state.laststoptime = state.cur_sample->stoptime.seconds;
+	state.laststopdepth = state.cur_sample->stopdepth.mm;
+	state.lastcns = state.cur_sample->cns;
+	state.lastpo2 = state.cur_sample->setpoint.mbar;
+	state.cur_sample = NULL;
 }
 
 static void divecomputer_start(void)
@@ -1637,7 +1729,7 @@ static void divecomputer_start(void)
 	struct divecomputer *dc;
 
 	/* Start from the previous dive computer */
-	dc = &cur_dive->dc;
+	dc = &state.cur_dive->dc;
 	while (dc->next)
 		dc = dc->next;
 
@@ -1651,26 +1743,26 @@ static void divecomputer_start(void)
 	}
 
 	/* .. this is the one we'll use */
-	cur_dc = dc;
+	state.cur_dc = dc;
 	reset_dc_info(dc);
 }
 
 static void divecomputer_end(void)
 {
-	if (!cur_dc->when)
-		cur_dc->when = cur_dive->when;
-	cur_dc = NULL;
+	if (!state.cur_dc->when)
+		state.cur_dc->when = state.cur_dive->when;
+	state.cur_dc = NULL;
 }
 
 static void userid_start(void)
 {
-	in_userid = true;
+	state.in_userid = true;
 	set_save_userid_local(true); //if the xml contains userid, keep saving it.
 }
 
 static void userid_stop(void)
 {
-	in_userid = false;
+	state.in_userid = false;
 }
 
 static bool entry(const char *name, char *buf)
@@ -1687,37 +1779,37 @@ static bool entry(const char *name, char *buf)
 			return false;
 		}
 	}
-	if (in_userid) {
+	if (state.in_userid) {
 		try_to_fill_userid(name, buf);
 		return true;
 	}
-	if (in_settings) {
+	if (state.in_settings) {
 		try_to_fill_dc_settings(name, buf);
 		try_to_match_autogroup(name, buf);
 		return true;
 	}
-	if (cur_dive_site) {
-		try_to_fill_dive_site(&cur_dive_site, name, buf);
+	if (state.cur_dive_site) {
+		try_to_fill_dive_site(&state.cur_dive_site, name, buf);
 		return true;
 	}
 	if (!cur_event.deleted) {
 		try_to_fill_event(name, buf);
 		return true;
 	}
-	if (cur_sample) {
-		try_to_fill_sample(cur_sample, name, buf);
+	if (state.cur_sample) {
+		try_to_fill_sample(state.cur_sample, name, buf);
 		return true;
 	}
-	if (cur_dc) {
-		try_to_fill_dc(cur_dc, name, buf);
+	if (state.cur_dc) {
+		try_to_fill_dc(state.cur_dc, name, buf);
 		return true;
 	}
-	if (cur_dive) {
-		try_to_fill_dive(cur_dive, name, buf);
+	if (state.cur_dive) {
+		try_to_fill_dive(state.cur_dive, name, buf);
 		return true;
 	}
-	if (cur_trip) {
-		try_to_fill_trip(&cur_trip, name, buf);
+	if (state.cur_trip) {
+		try_to_fill_trip(&state.cur_trip, name, buf);
 		return true;
 	}
 	return true;
@@ -1784,6 +1876,9 @@ static bool traverse_properties(xmlNode *node)
 	xmlAttr *p;
 	bool ret = true;
 
+	/* only elements have properties - the xmlTextReader keeps short text in there */
+	if (node->type != XML_ELEMENT_NODE)
+		return true;
 	for (p = node->properties; p; p = p->next)
 		if ((ret = traverse(p->children)) == false)
 			break;
@@ -1797,7 +1892,7 @@ static bool visit(xmlNode *n)
 
 static void DivingLog_importer(void)
 {
-	import_source = DIVINGLOG;
+	state.import_source = DIVINGLOG;
 
 	/*
 	 * Diving Log units are really strange.
@@ -1814,7 +1909,7 @@ static void DivingLog_importer(void)
 
 static void uddf_importer(void)
 {
-	import_source = UDDF;
+	state.import_source = UDDF;
 	xml_parsing_units = SI_units;
 	xml_parsing_units.pressure = PASCAL;
 	xml_parsing_units.temperature = KELVIN;
@@ -1855,13 +1950,25 @@ static struct nesting {
 	  { NULL, }
   };
 
+static struct nesting *find_nesting(const char *name)
+{
+	struct nesting *rule = nesting;
+
+	do {
+		if (!strcmp(rule->name, name))
+			break;
+		rule++;
+	} while (rule->name);
+	return rule;
+}
+
 static bool traverse(xmlNode *root)
 {
 	xmlNode *n;
 	bool ret = true;
 
 	for (n = root; n; n = n->next) {
-		struct nesting *rule = nesting;
+		struct nesting *rule;
 
 		if (!n->name) {
 			if ((ret = visit(n)) == false)
@@ -1869,12 +1976,7 @@ static bool traverse(xmlNode *root)
 			continue;
 		}
 
-		do {
-			if (!strcmp(rule->name, n->name))
-				break;
-			rule++;
-		} while (rule->name);
-
+		rule = find_nesting(n->name);
 		if (rule->start)
 			rule->start();
 		if ((ret = visit(n)) == false)
@@ -1896,7 +1998,7 @@ static void reset_all(void)
 	 * dive for that format.
 	 */
 	xml_parsing_units = SI_units;
-	import_source = UNKNOWN;
+	state.import_source = UNKNOWN;
 }
 
 /* divelog.de sends us xml files that claim to be iso-8859-1
@@ -1924,26 +2026,165 @@ const char *preprocess_divelog_de(const char *buffer)
 	return buffer;
 }
 
+/*
+ * The document tree never got to the dives of a file it couldn't
+ * read to the end, and the reader shouldn't import half of one
+ * either: drop the dive we were in the middle of and everything
+ * else this file added.
+ */
+static void discard_parsed_dives(int nr_dives, int nr_sites)
+{
+	/* an empty trip is ours to free, one with dives goes with its last dive */
+	if (state.cur_trip && !state.cur_trip->dives) {
+		free(state.cur_trip->location);
+		free(state.cur_trip->notes);
+		free(state.cur_trip);
+	}
+	state.cur_trip = NULL;
+
+	if (state.cur_dive) {
+		remove_dive_from_trip(state.cur_dive, false);
+		free_dive(state.cur_dive);
+		state.cur_dive = NULL;
+		state.cur_dc = NULL;
+	}
+	while (target_table->nr > nr_dives) {
+		struct dive *dive = target_table->dives[--target_table->nr];
+
+		target_table->dives[target_table->nr] = NULL;
+		remove_dive_from_trip(dive, false);
+		free_dive(dive);
+	}
+	while (dive_site_table.nr > nr_sites)
+		delete_dive_site(get_dive_site(dive_site_table.nr - 1)->uuid);
+}
+
+/*
+ * Our own XML files don't need a transform, so rather than building the
+ * whole document tree first we walk the nodes as xmlTextReader parses
+ * them. The reader only keeps the node it is on and the ancestors of it,
+ * so the memory used no longer grows with the size of the file; and as the
+ * ancestors are there, the nodes go through the same visit_one_node() and
+ * traverse_properties() as the document tree does.
+ *
+ * Returns 1 without having parsed anything if the file has to go through
+ * the document tree after all: if it needs an XSLT transform, or if the
+ * reader can't make sense of it before the root element.
+ */
+static int parse_xml_stream(const char *url, const char *buffer, int size)
+{
+	xmlTextReaderPtr reader;
+	xmlNode *node;
+	struct nesting *rule;
+	bool started = false;
+	int ret = 0, type;
+	int nr_dives = target_table->nr, nr_sites = dive_site_table.nr;
+
+	/* some of the buffers we get have the terminating NUL in their size */
+	while (size > 0 && !buffer[size - 1])
+		size--;
+	reader = xmlReaderForMemory(buffer, size, url, NULL, 0);
+	if (!reader)
+		return 1;
+	while ((ret = xmlTextReaderRead(reader)) == 1) {
+		node = xmlTextReaderCurrentNode(reader);
+		type = xmlTextReaderNodeType(reader);
+		if (!started) {
+			if (type != XML_READER_TYPE_ELEMENT)
+				continue;
+			if (needs_xslt_transform(node))
+				break;
+			started = true;
+			set_save_userid_local(false);
+			set_userid("");
+			reset_all();
+			dive_start();
+		}
+		switch (type) {
+		case XML_READER_TYPE_ELEMENT:
+			rule = find_nesting(node->name);
+			if (rule->start)
+				rule->start();
+			if (!visit_one_node(node) || !traverse_properties(node))
+				goto abort;
+			/* there's no end element for <sample ... /> */
+			if (xmlTextReaderIsEmptyElement(reader) && rule->end)
+				rule->end();
+			break;
+		case XML_READER_TYPE_END_ELEMENT:
+			rule = find_nesting(node->name);
+			if (rule->end)
+				rule->end();
+			break;
+		default:
+			/* text, CDATA and the like; skip anything after the root element */
+			if (xmlTextReaderDepth(reader) > 0 && !visit_one_node(node))
+				goto abort;
+		}
+	}
+	xmlFreeTextReader(reader);
+	if (!started)
+		return 1;
+	if (ret < 0) {
+		discard_parsed_dives(nr_dives, nr_sites);
+		return report_error(translate("gettextFromC", "Failed to parse '%s'"), url);
+	}
+	dive_end();
+	return 0;
+
+abort:
+	// we decided to give up on parsing... why?
+	xmlFreeTextReader(reader);
+	discard_parsed_dives(nr_dives, nr_sites);
+	return -1;
+}
+
 int parse_xml_buffer(const char *url, const char *buffer, int size,
 		      struct dive_table *table, const char **params)
 {
-	xmlDoc *doc;
-	const char *res = preprocess_divelog_de(buffer);
-	int ret = 0;
+	int ret;
 
 	target_table = table;
+	ret = parse_xml_stream(url, buffer, size);
+	if (ret != 1)
+		return ret;
+	return parse_xml_doc(url, read_xml_doc(url, buffer, params), table);
+}
+
+/*
+ * The first half of parse_xml_buffer() for the formats that are read as
+ * a whole: the document, transformed into our own format if there's a
+ * stylesheet for it, or NULL if it isn't XML. This doesn't touch the
+ * parser state or any of the tables, so several buffers can be read at
+ * the same time (see try_to_open_zip()).
+ */
+xmlDoc *read_xml_doc(const char *url, const char *buffer, const char **params)
+{
+	xmlDoc *doc;
+	const char *res;
+
+	res = preprocess_divelog_de(buffer);
 	doc = xmlReadMemory(res, strlen(res), url, NULL, 0);
 	if (res != buffer)
 		free((char *)res);
+	if (!doc)
+		return NULL;
+	return test_xslt_transforms(doc, params);
+}
+
+/* The second half: add the dives of a document from read_xml_doc() to the table */
+int parse_xml_doc(const char *url, xmlDoc *doc, struct dive_table *table)
+{
+	int ret = 0;
 
 	if (!doc)
 		return report_error(translate("gettextFromC", "Failed to parse '%s'"), url);
 
+	target_table = table;
 	set_save_userid_local(false);
 	set_userid("");
 	reset_all();
 	dive_start();
-	doc = test_xslt_transforms(doc, params);
 	if (!traverse(xmlDocGetRootElement(doc))) {
 		// we decided to give up on parsing... why?
 		ret = -1;
@@ -1954,10 +2195,269 @@ int parse_xml_buffer(const char *url, const char *buffer, int size,
 	return ret;
 }
 
+/*
+ * Generic CSV sample import.
+ *
+ * This does what xslt/csv2xml.xslt does with the same parameters, but
+ * walks the buffer directly instead of wrapping it in a <csv> element
+ * and having the stylesheet peel it apart one recursive template call
+ * per line and per field. The values still go through the same setters
+ * as the XML attributes the stylesheet would have generated, so units
+ * and odd readings are handled exactly the same way.
+ */
+#define CSV_FIELD_LEN 256
+
+static const char *csv_param(const char **params, const char *name)
+{
+	for (; params && params[0]; params += 2)
+		if (!strcmp(params[0], name))
+			return params[1];
+	return NULL;
+}
+
+static int csv_index(const char **params, const char *name)
+{
+	const char *value = csv_param(params, name);
+
+	return value ? atoi(value) : -1;
+}
+
+/* A line ends at LF, CR or CRLF, just like the XML parser sees it */
+static const char *csv_eol(const char *p, const char *end)
+{
+	const char *lf = memchr(p, '\n', end - p);
+	const char *cr = memchr(p, '\r', (lf ? lf : end) - p);
+
+	return cr ? cr : lf ? lf : end;
+}
+
+static const char *csv_next_line(const char *eol, const char *end)
+{
+	if (eol == end)
+		return end;
+	if (*eol == '\r' && eol + 1 < end && eol[1] == '\n')
+		return eol + 2;
+	return eol + 1;
+}
+
+/*
+ * Copy field 'index' of the line into buf, with the rules of
+ * getFieldByIndex in commonTemplates.xsl: separators inside quotes
+ * are not special for the field we want, but they are for the ones
+ * we skip.
+ */
+static char *csv_field(const char *line, const char *eol, int index, char sep, char *buf)
+{
+	const char *p = line, *field_end;
+	int len;
+
+	while (index-- > 0) {
+		p = memchr(p, sep, eol - p);
+		if (!p) {
+			*buf = '\0';
+			return buf;
+		}
+		p++;
+	}
+	if (p < eol && *p == '"') {
+		p++;
+		field_end = memchr(p, '"', eol - p);
+	} else {
+		field_end = memchr(p, sep, eol - p);
+	}
+	if (!field_end)
+		field_end = eol;
+	len = field_end - p;
+	if (len >= CSV_FIELD_LEN)
+		len = CSV_FIELD_LEN - 1;
+	memcpy(buf, p, len);
+	buf[len] = '\0';
+	return buf;
+}
+
+/* XPath number(): only an optional minus, digits and a decimal dot */
+static bool csv_number(const char *buf, double *res)
+{
+	const char *end;
+
+	while (*buf == ' ' || *buf == '\t')
+		buf++;
+	if (*buf == '+')
+		return false;
+	*res = strtod_flags(buf, &end, STRTOD_NO_COMMA | STRTOD_NO_EXPONENT);
+	if (end == buf)
+		return false;
+	while (*end == ' ' || *end == '\t')
+		end++;
+	return !*end;
+}
+
+/*
+ * The stylesheet turns the time into a sample attribute only if it,
+ * or the part up to the first colon, is a number. That's what skips
+ * header lines. Plain numbers are seconds, otherwise it's m:s or h:m:s.
+ */
+static bool csv_time(char *value, duration_t *time)
+{
+	char *colon = strchr(value, ':');
+	double sec, min, hours;
+
+	if (csv_number(value, &sec)) {
+		/* rounded to full seconds like sec2time does */
+		time->seconds = floor(sec / 60) * 60 + floor(fmod(sec, 60) + 0.5);
+		return true;
+	}
+	if (!colon)
+		return false;
+	*colon = '\0';
+	if (!csv_number(value, &min))
+		return false;
+	value = colon + 1;
+	colon = strchr(value, ':');
+	if (!colon) {
+		if (csv_number(value, &sec))
+			time->seconds = min * 60 + sec;
+		return true;
+	}
+	*colon = '\0';
+	hours = min;
+	if (csv_number(value, &min))
+		time->seconds = (int)(hours * 60 + min) * 60 + atoi(colon + 1);
+	return true;
+}
+
+/* Empty or blank attributes never make it to entry() in the XML path */
+static void csv_fill_sample(const char *name, char *buf)
+{
+	if (buf[strspn(buf, " \t")])
+		try_to_fill_sample(state.cur_sample, name, buf);
+}
+
+static void csv_fill_converted(const char *name, char *buf, const char *fmt, double factor, double offset)
+{
+	double val;
+
+	if (csv_number(buf, &val))
+		snprintf(buf, CSV_FIELD_LEN, fmt, (val - offset) * factor);
+	else
+		strcpy(buf, "NaN");
+	try_to_fill_sample(state.cur_sample, name, buf);
+}
+
+static const struct {
+	const char *param, *name;
+} csv_columns[] = {
+	{ "po2Field", "po2.sample" },
+	{ "cnsField", "cns.sample" },
+	{ "ndlField", "ndl.sample" },
+	{ "ttsField", "tts.sample" },
+	{ "pressureField", "pressure.sample" },
+};
+
+#define CSV_COLUMNS (sizeof(csv_columns) / sizeof(csv_columns[0]))
+
+int parse_csv_buffer(const char *url, const char *buffer, int size,
+		     struct dive_table *table, const char **params)
+{
+	const char *end = buffer + size;
+	const char *line, *eol, *next, *next_eol;
+	const char *curdate = csv_param(params, "date");
+	const char *curtime = csv_param(params, "time");
+	int timef = csv_index(params, "timeField");
+	int depthf = csv_index(params, "depthField");
+	int tempf = csv_index(params, "tempField");
+	int stopdepthf = csv_index(params, "stopdepthField");
+	int columns[CSV_COLUMNS];
+	bool imperial = csv_index(params, "units") != 0;
+	char sep;
+	char buf[CSV_FIELD_LEN];
+	duration_t sampletime;
+	unsigned int i;
+
+	switch (csv_index(params, "separatorIndex")) {
+	case 0:
+		sep = '\t';
+		break;
+	case 2:
+		sep = ';';
+		break;
+	default:
+		sep = ',';
+	}
+	for (i = 0; i < CSV_COLUMNS; i++)
+		columns[i] = csv_index(params, csv_columns[i].param);
+
+	target_table = table;
+	reset_all();
+	dive_start();
+
+	/* the stylesheet gets the current date as YYYYMMDD and the time as 1HHMM */
+	if (curdate && strlen(curdate) >= 8) {
+		snprintf(buf, sizeof(buf), "%.4s-%.2s-%.2s", curdate, curdate + 4, curdate + 6);
+		divedate(buf, &state.cur_dive->when);
+	}
+	if (curtime && strlen(curtime) >= 5) {
+		snprintf(buf, sizeof(buf), "%.2s:%.2s", curtime + 1, curtime + 3);
+		divetime(buf, &state.cur_dive->when);
+	}
+
+	line = buffer;
+	eol = size > 0 ? csv_eol(line, end) : end;
+	while (line < end) {
+		next = csv_next_line(eol, end);
+		next_eol = csv_eol(next, end);
+
+		/* Like the stylesheet, skip lines that are repeated verbatim */
+		if (eol - line != next_eol - next || memcmp(line, next, eol - line)) {
+			sampletime.seconds = 0;
+			if (csv_time(csv_field(line, eol, timef, sep, buf), &sampletime)) {
+				sample_start();
+				state.cur_sample->time = sampletime;
+
+				csv_field(line, eol, depthf, sep, buf);
+				if (imperial)
+					csv_fill_converted("depth.sample", buf, "%.15g", 0.3048, 0);
+				else
+					csv_fill_sample("depth.sample", buf);
+
+				if (tempf >= 0) {
+					csv_field(line, eol, tempf, sep, buf);
+					if (imperial)
+						csv_fill_converted("temp.sample", buf, "%.1f C", 5.0 / 9, 32);
+					else
+						csv_fill_sample("temp.sample", buf);
+				}
+
+				for (i = 0; i < CSV_COLUMNS; i++)
+					if (columns[i] >= 0)
+						csv_fill_sample(csv_columns[i].name, csv_field(line, eol, columns[i], sep, buf));
+
+				if (stopdepthf >= 0) {
+					double stopdepth;
+
+					csv_field(line, eol, stopdepthf, sep, buf);
+					state.cur_sample->in_deco = csv_number(buf, &stopdepth) && stopdepth > 0;
+					if (imperial)
+						csv_fill_converted("stopdepth.sample", buf, "%.2f", 0.3048, 0);
+					else
+						csv_fill_sample("stopdepth.sample", buf);
+				}
+				sample_end();
+			}
+		}
+		line = next;
+		eol = next_eol;
+	}
+	dive_end();
+
+	return 0;
+}
+
+
 void parse_mkvi_buffer(struct membuffer *txt, struct membuffer *csv, const char *starttime)
 {
 	dive_start();
-	divedate(starttime, &cur_dive->when);
+	divedate(starttime, &state.cur_dive->when);
 	dive_end();
 }
 
@@ -2093,22 +2593,22 @@ extern int dm5_cylinders(void *handle, int columns, char **data, char **column)
 {
 	cylinder_start();
 	if (data[7] && atoi(data[7]) > 0 && atoi(data[7]) < 350000)
-		cur_dive->cylinder[cur_cylinder_index].start.mbar = atoi(data[7]);
+		state.cur_dive->cylinder[state.cur_cylinder_index].start.mbar = atoi(data[7]);
 	if (data[8] && atoi(data[8]) > 0 && atoi(data[8]) < 350000)
-		cur_dive->cylinder[cur_cylinder_index].end.mbar = (atoi(data[8]));
+		state.cur_dive->cylinder[state.cur_cylinder_index].end.mbar = (atoi(data[8]));
 	if (data[6]) {
 		/* DM5 shows tank size of 12 liters when the actual
 		 * value is 0 (and using metric units). So we just use
 		 * the same 12 liters when size is not available */
-		if (atof(data[6]) == 0.0 && cur_dive->cylinder[cur_cylinder_index].start.mbar)
-			cur_dive->cylinder[cur_cylinder_index].type.size.mliter = 12000;
+		if (atof(data[6]) == 0.0 && state.cur_dive->cylinder[state.cur_cylinder_index].start.mbar)
+			state.cur_dive->cylinder[state.cur_cylinder_index].type.size.mliter = 12000;
 		else
-			cur_dive->cylinder[cur_cylinder_index].type.size.mliter = (atof(data[6])) * 1000;
+			state.cur_dive->cylinder[state.cur_cylinder_index].type.size.mliter = (atof(data[6])) * 1000;
 	}
 	if (data[2])
-		cur_dive->cylinder[cur_cylinder_index].gasmix.o2.permille = atoi(data[2]) * 10;
+		state.cur_dive->cylinder[state.cur_cylinder_index].gasmix.o2.permille = atoi(data[2]) * 10;
 	if (data[3])
-		cur_dive->cylinder[cur_cylinder_index].gasmix.he.permille = atoi(data[3]) * 10;
+		state.cur_dive->cylinder[state.cur_cylinder_index].gasmix.he.permille = atoi(data[3]) * 10;
 	cylinder_end();
 	return 0;
 }
@@ -2130,7 +2630,7 @@ extern int dm5_gaschange(void *handle, int columns, char **data, char **column)
 extern int dm4_tags(void *handle, int columns, char **data, char **column)
 {
 	if (data[0])
-		taglist_add_tag(&cur_dive->tag_list, data[0]);
+		taglist_add_tag(&state.cur_dive->tag_list, data[0]);
 
 	return 0;
 }
@@ -2148,11 +2648,11 @@ extern int dm4_dive(void *param, int columns, char **data, char **column)
 	char get_events[64];
 
 	dive_start();
-	cur_dive->number = atoi(data[0]);
+	state.cur_dive->number = atoi(data[0]);
 
-	cur_dive->when = (time_t)(atol(data[1]));
+	state.cur_dive->when = (time_t)(atol(data[1]));
 	if (data[2])
-		utf8_string(data[2], &cur_dive->notes);
+		utf8_string(data[2], &state.cur_dive->notes);
 
 	/*
 	 * DM4 stores Duration and DiveTime. It looks like DiveTime is
@@ -2162,9 +2662,9 @@ extern int dm4_dive(void *param, int columns, char **data, char **column)
 	 * DiveTime = data[15]
 	 */
 	if (data[3])
-		cur_dive->duration.seconds = atoi(data[3]);
+		state.cur_dive->duration.seconds = atoi(data[3]);
 	if (data[15])
-		cur_dive->dc.duration.seconds = atoi(data[15]);
+		state.cur_dive->dc.duration.seconds = atoi(data[15]);
 
 	/*
 	 * TODO: the deviceid hash should be calculated here.
@@ -2172,73 +2672,73 @@ extern int dm4_dive(void *param, int columns, char **data, char **column)
 	settings_start();
 	dc_settings_start();
 	if (data[4])
-		utf8_string(data[4], &cur_settings.dc.serial_nr);
+		utf8_string(data[4], &state.cur_settings.dc.serial_nr);
 	if (data[5])
-		utf8_string(data[5], &cur_settings.dc.model);
+		utf8_string(data[5], &state.cur_settings.dc.model);
 
-	cur_settings.dc.deviceid = 0xffffffff;
+	state.cur_settings.dc.deviceid = 0xffffffff;
 	dc_settings_end();
 	settings_end();
 
 	if (data[6])
-		cur_dive->dc.maxdepth.mm = atof(data[6]) * 1000;
+		state.cur_dive->dc.maxdepth.mm = atof(data[6]) * 1000;
 	if (data[8])
-		cur_dive->dc.airtemp.mkelvin = C_to_mkelvin(atoi(data[8]));
+		state.cur_dive->dc.airtemp.mkelvin = C_to_mkelvin(atoi(data[8]));
 	if (data[9])
-		cur_dive->dc.watertemp.mkelvin = C_to_mkelvin(atoi(data[9]));
+		state.cur_dive->dc.watertemp.mkelvin = C_to_mkelvin(atoi(data[9]));
 
 	/*
 	 * TODO: handle multiple cylinders
 	 */
 	cylinder_start();
 	if (data[22] && atoi(data[22]) > 0)
-		cur_dive->cylinder[cur_cylinder_index].start.mbar = atoi(data[22]);
+		state.cur_dive->cylinder[state.cur_cylinder_index].start.mbar = atoi(data[22]);
 	else if (data[10] && atoi(data[10]) > 0)
-		cur_dive->cylinder[cur_cylinder_index].start.mbar = atoi(data[10]);
+		state.cur_dive->cylinder[state.cur_cylinder_index].start.mbar = atoi(data[10]);
 	if (data[23] && atoi(data[23]) > 0)
-		cur_dive->cylinder[cur_cylinder_index].end.mbar = (atoi(data[23]));
+		state.cur_dive->cylinder[state.cur_cylinder_index].end.mbar = (atoi(data[23]));
 	if (data[11] && atoi(data[11]) > 0)
-		cur_dive->cylinder[cur_cylinder_index].end.mbar = (atoi(data[11]));
+		state.cur_dive->cylinder[state.cur_cylinder_index].end.mbar = (atoi(data[11]));
 	if (data[12])
-		cur_dive->cylinder[cur_cylinder_index].type.size.mliter = (atof(data[12])) * 1000;
+		state.cur_dive->cylinder[state.cur_cylinder_index].type.size.mliter = (atof(data[12])) * 1000;
 	if (data[13])
-		cur_dive->cylinder[cur_cylinder_index].type.workingpressure.mbar = (atoi(data[13]));
+		state.cur_dive->cylinder[state.cur_cylinder_index].type.workingpressure.mbar = (atoi(data[13]));
 	if (data[20])
-		cur_dive->cylinder[cur_cylinder_index].gasmix.o2.permille = atoi(data[20]) * 10;
+		state.cur_dive->cylinder[state.cur_cylinder_index].gasmix.o2.permille = atoi(data[20]) * 10;
 	if (data[21])
-		cur_dive->cylinder[cur_cylinder_index].gasmix.he.permille = atoi(data[21]) * 10;
+		state.cur_dive->cylinder[state.cur_cylinder_index].gasmix.he.permille = atoi(data[21]) * 10;
 	cylinder_end();
 
 	if (data[14])
-		cur_dive->dc.surface_pressure.mbar = (atoi(data[14]) * 1000);
+		state.cur_dive->dc.surface_pressure.mbar = (atoi(data[14]) * 1000);
 
 	interval = data[16] ? atoi(data[16]) : 0;
 	profileBlob = (float *)data[17];
 	tempBlob = (unsigned char *)data[18];
 	pressureBlob = (int *)data[19];
-	for (i = 0; interval && i * interval < cur_dive->duration.seconds; i++) {
+	for (i = 0; interval && i * interval < state.cur_dive->duration.seconds; i++) {
 		sample_start();
-		cur_sample->time.seconds = i * interval;
+		state.cur_sample->time.seconds = i * interval;
 		if (profileBlob)
-			cur_sample->depth.mm = profileBlob[i] * 1000;
+			state.cur_sample->depth.mm = profileBlob[i] * 1000;
 		else
-			cur_sample->depth.mm = cur_dive->dc.maxdepth.mm;
+			state.cur_sample->depth.mm = state.cur_dive->dc.maxdepth.mm;
 
 		if (data[18] && data[18][0])
-			cur_sample->temperature.mkelvin = C_to_mkelvin(tempBlob[i]);
+			state.cur_sample->temperature.mkelvin = C_to_mkelvin(tempBlob[i]);
 		if (data[19] && data[19][0])
-			cur_sample->cylinderpressure.mbar = pressureBlob[i];
+			state.cur_sample->cylinderpressure.mbar = pressureBlob[i];
 		sample_end();
 	}
 
-	snprintf(get_events, sizeof(get_events) - 1, get_events_template, cur_dive->number);
+	snprintf(get_events, sizeof(get_events) - 1, get_events_template, state.cur_dive->number);
 	retval = sqlite3_exec(handle, get_events, &dm4_events, 0, &err);
 	if (retval != SQLITE_OK) {
 		fprintf(stderr, "%s", translate("gettextFromC", "Database query dm4_events failed.\n"));
 		return 1;
 	}
 
-	snprintf(get_events, sizeof(get_events) - 1, get_tags_template, cur_dive->number);
+	snprintf(get_events, sizeof(get_events) - 1, get_tags_template, state.cur_dive->number);
 	retval = sqlite3_exec(handle, get_events, &dm4_tags, 0, &err);
 	if (retval != SQLITE_OK) {
 		fprintf(stderr, "%s", translate("gettextFromC", "Database query dm4_tags failed.\n"));
@@ -2274,16 +2774,16 @@ extern int dm5_dive(void *param, int columns, char **data, char **column)
 	char get_events[512];
 
 	dive_start();
-	cur_dive->number = atoi(data[0]);
+	state.cur_dive->number = atoi(data[0]);
 
-	cur_dive->when = (time_t)(atol(data[1]));
+	state.cur_dive->when = (time_t)(atol(data[1]));
 	if (data[2])
-		utf8_string(data[2], &cur_dive->notes);
+		utf8_string(data[2], &state.cur_dive->notes);
 
 	if (data[3])
-		cur_dive->duration.seconds = atoi(data[3]);
+		state.cur_dive->duration.seconds = atoi(data[3]);
 	if (data[15])
-		cur_dive->dc.duration.seconds = atoi(data[15]);
+		state.cur_dive->dc.duration.seconds = atoi(data[15]);
 
 	/*
 	 * TODO: the deviceid hash should be calculated here.
@@ -2291,29 +2791,29 @@ extern int dm5_dive(void *param, int columns, char **data, char **column)
 	settings_start();
 	dc_settings_start();
 	if (data[4]) {
-		utf8_string(data[4], &cur_settings.dc.serial_nr);
-		cur_settings.dc.deviceid = atoi(data[4]);
+		utf8_string(data[4], &state.cur_settings.dc.serial_nr);
+		state.cur_settings.dc.deviceid = atoi(data[4]);
 	}
 	if (data[5])
-		utf8_string(data[5], &cur_settings.dc.model);
+		utf8_string(data[5], &state.cur_settings.dc.model);
 
 	dc_settings_end();
 	settings_end();
 
 	if (data[6])
-		cur_dive->dc.maxdepth.mm = atof(data[6]) * 1000;
+		state.cur_dive->dc.maxdepth.mm = atof(data[6]) * 1000;
 	if (data[8])
-		cur_dive->dc.airtemp.mkelvin = C_to_mkelvin(atoi(data[8]));
+		state.cur_dive->dc.airtemp.mkelvin = C_to_mkelvin(atoi(data[8]));
 	if (data[9])
-		cur_dive->dc.watertemp.mkelvin = C_to_mkelvin(atoi(data[9]));
+		state.cur_dive->dc.watertemp.mkelvin = C_to_mkelvin(atoi(data[9]));
 
 	if (data[4]) {
-		cur_dive->dc.deviceid = atoi(data[4]);
+		state.cur_dive->dc.deviceid = atoi(data[4]);
 	}
 	if (data[5])
-		utf8_string(data[5], &cur_dive->dc.model);
+		utf8_string(data[5], &state.cur_dive->dc.model);
 
-	snprintf(get_events, sizeof(get_events) - 1, get_cylinders_template, cur_dive->number);
+	snprintf(get_events, sizeof(get_events) - 1, get_cylinders_template, state.cur_dive->number);
 	retval = sqlite3_exec(handle, get_events, &dm5_cylinders, 0, &err);
 	if (retval != SQLITE_OK) {
 		fprintf(stderr, "%s", translate("gettextFromC", "Database query dm5_cylinders failed.\n"));
@@ -2321,26 +2821,26 @@ extern int dm5_dive(void *param, int columns, char **data, char **column)
 	}
 
 	if (data[14])
-		cur_dive->dc.surface_pressure.mbar = (atoi(data[14]) / 100);
+		state.cur_dive->dc.surface_pressure.mbar = (atoi(data[14]) / 100);
 
 	interval = data[16] ? atoi(data[16]) : 0;
 	sampleBlob = (unsigned const char *)data[24];
-	for (i = 0; interval && sampleBlob && i * interval < cur_dive->duration.seconds; i++) {
+	for (i = 0; interval && sampleBlob && i * interval < state.cur_dive->duration.seconds; i++) {
 		float *depth = (float *)&sampleBlob[i * 16 + 3];
 		int32_t temp = (sampleBlob[i * 16 + 10] << 8) + sampleBlob[i * 16 + 11];
 		int32_t pressure = (sampleBlob[i * 16 + 9] << 16) + (sampleBlob[i * 16 + 8] << 8) + sampleBlob[i * 16 + 7];
 
 		sample_start();
-		cur_sample->time.seconds = i * interval;
-		cur_sample->depth.mm = depth[0] * 1000;
+		state.cur_sample->time.seconds = i * interval;
+		state.cur_sample->depth.mm = depth[0] * 1000;
 		/*
 		 * Limit temperatures and cylinder pressures to somewhat
 		 * sensible values
 		 */
 		if (temp >= -10 && temp < 50)
-			cur_sample->temperature.mkelvin = C_to_mkelvin(temp);
+			state.cur_sample->temperature.mkelvin = C_to_mkelvin(temp);
 		if (pressure >= 0 && pressure < 350000)
-			cur_sample->cylinderpressure.mbar = pressure;
+			state.cur_sample->cylinderpressure.mbar = pressure;
 		sample_end();
 	}
 
@@ -2357,37 +2857,37 @@ extern int dm5_dive(void *param, int columns, char **data, char **column)
 		profileBlob = (float *)data[17];
 		tempBlob = (unsigned char *)data[18];
 		pressureBlob = (int *)data[19];
-		for (i = 0; interval && i * interval < cur_dive->duration.seconds; i++) {
+		for (i = 0; interval && i * interval < state.cur_dive->duration.seconds; i++) {
 			sample_start();
-			cur_sample->time.seconds = i * interval;
+			state.cur_sample->time.seconds = i * interval;
 			if (profileBlob)
-				cur_sample->depth.mm = profileBlob[i] * 1000;
+				state.cur_sample->depth.mm = profileBlob[i] * 1000;
 			else
-				cur_sample->depth.mm = cur_dive->dc.maxdepth.mm;
+				state.cur_sample->depth.mm = state.cur_dive->dc.maxdepth.mm;
 
 			if (data[18] && data[18][0])
-				cur_sample->temperature.mkelvin = C_to_mkelvin(tempBlob[i]);
+				state.cur_sample->temperature.mkelvin = C_to_mkelvin(tempBlob[i]);
 			if (data[19] && data[19][0])
-				cur_sample->cylinderpressure.mbar = pressureBlob[i];
+				state.cur_sample->cylinderpressure.mbar = pressureBlob[i];
 			sample_end();
 		}
 	}
 
-	snprintf(get_events, sizeof(get_events) - 1, get_gaschange_template, cur_dive->number);
+	snprintf(get_events, sizeof(get_events) - 1, get_gaschange_template, state.cur_dive->number);
 	retval = sqlite3_exec(handle, get_events, &dm5_gaschange, 0, &err);
 	if (retval != SQLITE_OK) {
 		fprintf(stderr, "%s", translate("gettextFromC", "Database query dm5_gaschange failed.\n"));
 		return 1;
 	}
 
-	snprintf(get_events, sizeof(get_events) - 1, get_events_template, cur_dive->number);
+	snprintf(get_events, sizeof(get_events) - 1, get_events_template, state.cur_dive->number);
 	retval = sqlite3_exec(handle, get_events, &dm4_events, 0, &err);
 	if (retval != SQLITE_OK) {
 		fprintf(stderr, "%s", translate("gettextFromC", "Database query dm4_events failed.\n"));
 		return 1;
 	}
 
-	snprintf(get_events, sizeof(get_events) - 1, get_tags_template, cur_dive->number);
+	snprintf(get_events, sizeof(get_events) - 1, get_tags_template, state.cur_dive->number);
 	retval = sqlite3_exec(handle, get_events, &dm4_tags, 0, &err);
 	if (retval != SQLITE_OK) {
 		fprintf(stderr, "%s", translate("gettextFromC", "Database query dm4_tags failed.\n"));
@@ -2446,9 +2946,9 @@ extern int shearwater_cylinders(void *handle, int columns, char **data, char **c
 {
 	cylinder_start();
 	if (data[0])
-		cur_dive->cylinder[cur_cylinder_index].gasmix.o2.permille = atof(data[0]) * 1000;
+		state.cur_dive->cylinder[state.cur_cylinder_index].gasmix.o2.permille = atof(data[0]) * 1000;
 	if (data[1])
-		cur_dive->cylinder[cur_cylinder_index].gasmix.he.permille = atof(data[1]) * 1000;
+		state.cur_dive->cylinder[state.cur_cylinder_index].gasmix.he.permille = atof(data[1]) * 1000;
 	cylinder_end();
 
 	return 0;
@@ -2473,11 +2973,11 @@ extern int cobalt_profile_sample(void *handle, int columns, char **data, char **
 {
 	sample_start();
 	if (data[0])
-		cur_sample->time.seconds = atoi(data[0]);
+		state.cur_sample->time.seconds = atoi(data[0]);
 	if (data[1])
-		cur_sample->depth.mm = atoi(data[1]);
+		state.cur_sample->depth.mm = atoi(data[1]);
 	if (data[2])
-		cur_sample->temperature.mkelvin = metric ? C_to_mkelvin(atof(data[2])) : F_to_mkelvin(atof(data[2]));
+		state.cur_sample->temperature.mkelvin = metric ? C_to_mkelvin(atof(data[2])) : F_to_mkelvin(atof(data[2]));
 	sample_end();
 
 	return 0;
@@ -2488,26 +2988,26 @@ extern int shearwater_profile_sample(void *handle, int columns, char **data, cha
 {
 	sample_start();
 	if (data[0])
-		cur_sample->time.seconds = atoi(data[0]);
+		state.cur_sample->time.seconds = atoi(data[0]);
 	if (data[1])
-		cur_sample->depth.mm = metric ? atof(data[1]) * 1000 : feet_to_mm(atof(data[1]));
+		state.cur_sample->depth.mm = metric ? atof(data[1]) * 1000 : feet_to_mm(atof(data[1]));
 	if (data[2])
-		cur_sample->temperature.mkelvin = metric ? C_to_mkelvin(atof(data[2])) : F_to_mkelvin(atof(data[2]));
+		state.cur_sample->temperature.mkelvin = metric ? C_to_mkelvin(atof(data[2])) : F_to_mkelvin(atof(data[2]));
 	if (data[3]) {
-		cur_sample->setpoint.mbar = atof(data[3]) * 1000;
-		cur_dive->dc.divemode = CCR;
+		state.cur_sample->setpoint.mbar = atof(data[3]) * 1000;
+		state.cur_dive->dc.divemode = CCR;
 	}
 	if (data[4])
-		cur_sample->ndl.seconds = atoi(data[4]) * 60;
+		state.cur_sample->ndl.seconds = atoi(data[4]) * 60;
 	if (data[5])
-		cur_sample->cns = atoi(data[5]);
+		state.cur_sample->cns = atoi(data[5]);
 	if (data[6])
-		cur_sample->stopdepth.mm = metric ? atoi(data[6]) * 1000 : feet_to_mm(atoi(data[6]));
+		state.cur_sample->stopdepth.mm = metric ? atoi(data[6]) * 1000 : feet_to_mm(atoi(data[6]));
 
 	/* We don't actually have data[3], but it should appear in the
 	 * SQL query at some point.
 	if (data[3])
-		cur_sample->cylinderpressure.mbar = metric ? atoi(data[3]) * 1000 : psi_to_mbar(atoi(data[3]));
+		state.cur_sample->cylinderpressure.mbar = metric ? atoi(data[3]) * 1000 : psi_to_mbar(atoi(data[3]));
 	 */
 	sample_end();
 
@@ -2525,57 +3025,57 @@ extern int shearwater_dive(void *param, int columns, char **data, char **column)
 	char get_buffer[1024];
 
 	dive_start();
-	cur_dive->number = atoi(data[0]);
+	state.cur_dive->number = atoi(data[0]);
 
-	cur_dive->when = (time_t)(atol(data[1]));
+	state.cur_dive->when = (time_t)(atol(data[1]));
 
 	if (data[2])
-		add_dive_site(data[2], cur_dive);
+		add_dive_site(data[2], state.cur_dive);
 	if (data[3])
-		utf8_string(data[3], &cur_dive->buddy);
+		utf8_string(data[3], &state.cur_dive->buddy);
 	if (data[4])
-		utf8_string(data[4], &cur_dive->notes);
+		utf8_string(data[4], &state.cur_dive->notes);
 
 	metric = atoi(data[5]) == 1 ? 0 : 1;
 
 	/* TODO: verify that metric calculation is correct */
 	if (data[6])
-		cur_dive->dc.maxdepth.mm = metric ? atof(data[6]) * 1000 : feet_to_mm(atof(data[6]));
+		state.cur_dive->dc.maxdepth.mm = metric ? atof(data[6]) * 1000 : feet_to_mm(atof(data[6]));
 
 	if (data[7])
-		cur_dive->dc.duration.seconds = atoi(data[7]) * 60;
+		state.cur_dive->dc.duration.seconds = atoi(data[7]) * 60;
 
 	if (data[8])
-		cur_dive->dc.surface_pressure.mbar = atoi(data[8]);
+		state.cur_dive->dc.surface_pressure.mbar = atoi(data[8]);
 	/*
 	 * TODO: the deviceid hash should be calculated here.
 	 */
 	settings_start();
 	dc_settings_start();
 	if (data[9])
-		utf8_string(data[9], &cur_settings.dc.serial_nr);
+		utf8_string(data[9], &state.cur_settings.dc.serial_nr);
 	if (data[10])
-		utf8_string(data[10], &cur_settings.dc.model);
+		utf8_string(data[10], &state.cur_settings.dc.model);
 
-	cur_settings.dc.deviceid = 0xffffffff;
+	state.cur_settings.dc.deviceid = 0xffffffff;
 	dc_settings_end();
 	settings_end();
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_cylinder_template, cur_dive->number);
+	snprintf(get_buffer, sizeof(get_buffer) - 1, get_cylinder_template, state.cur_dive->number);
 	retval = sqlite3_exec(handle, get_buffer, &shearwater_cylinders, 0, &err);
 	if (retval != SQLITE_OK) {
 		fprintf(stderr, "%s", translate("gettextFromC", "Database query shearwater_cylinders failed.\n"));
 		return 1;
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_changes_template, cur_dive->number, cur_dive->number);
+	snprintf(get_buffer, sizeof(get_buffer) - 1, get_changes_template, state.cur_dive->number, state.cur_dive->number);
 	retval = sqlite3_exec(handle, get_buffer, &shearwater_changes, 0, &err);
 	if (retval != SQLITE_OK) {
 		fprintf(stderr, "%s", translate("gettextFromC", "Database query shearwater_changes failed.\n"));
 		return 1;
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_profile_template, cur_dive->number);
+	snprintf(get_buffer, sizeof(get_buffer) - 1, get_profile_template, state.cur_dive->number);
 	retval = sqlite3_exec(handle, get_buffer, &shearwater_profile_sample, 0, &err);
 	if (retval != SQLITE_OK) {
 		fprintf(stderr, "%s", translate("gettextFromC", "Database query shearwater_profile_sample failed.\n"));
@@ -2591,17 +3091,17 @@ extern int cobalt_cylinders(void *handle, int columns, char **data, char **colum
 {
 	cylinder_start();
 	if (data[0])
-		cur_dive->cylinder[cur_cylinder_index].gasmix.o2.permille = atoi(data[0]) * 10;
+		state.cur_dive->cylinder[state.cur_cylinder_index].gasmix.o2.permille = atoi(data[0]) * 10;
 	if (data[1])
-		cur_dive->cylinder[cur_cylinder_index].gasmix.he.permille = atoi(data[1]) * 10;
+		state.cur_dive->cylinder[state.cur_cylinder_index].gasmix.he.permille = atoi(data[1]) * 10;
 	if (data[2])
-		cur_dive->cylinder[cur_cylinder_index].start.mbar = psi_to_mbar(atoi(data[2]));
+		state.cur_dive->cylinder[state.cur_cylinder_index].start.mbar = psi_to_mbar(atoi(data[2]));
 	if (data[3])
-		cur_dive->cylinder[cur_cylinder_index].end.mbar = psi_to_mbar(atoi(data[3]));
+		state.cur_dive->cylinder[state.cur_cylinder_index].end.mbar = psi_to_mbar(atoi(data[3]));
 	if (data[4])
-		cur_dive->cylinder[cur_cylinder_index].type.size.mliter = atoi(data[4]) * 100;
+		state.cur_dive->cylinder[state.cur_cylinder_index].type.size.mliter = atoi(data[4]) * 100;
 	if (data[5])
-		cur_dive->cylinder[cur_cylinder_index].gas_used.mliter = atoi(data[5]) * 1000;
+		state.cur_dive->cylinder[state.cur_cylinder_index].gas_used.mliter = atoi(data[5]) * 1000;
 	cylinder_end();
 
 	return 0;
@@ -2610,7 +3110,7 @@ extern int cobalt_cylinders(void *handle, int columns, char **data, char **colum
 extern int cobalt_buddies(void *handle, int columns, char **data, char **column)
 {
 	if (data[0])
-		utf8_string(data[0], &cur_dive->buddy);
+		utf8_string(data[0], &state.cur_dive->buddy);
 
 	return 0;
 }
@@ -2636,7 +3136,7 @@ extern int cobalt_location(void *handle, int columns, char **data, char **column
 			sprintf(tmp, "%s / %s", location, data[0]);
 			free(location);
 			location = NULL;
-			cur_dive->dive_site_uuid = create_dive_site(tmp);
+			state.cur_dive->dive_site_uuid = create_dive_site(tmp);
 			free(tmp);
 		} else {
 			location = strdup(data[0]);
@@ -2660,12 +3160,12 @@ extern int cobalt_dive(void *param, int columns, char **data, char **column)
 	char get_buffer[1024];
 
 	dive_start();
-	cur_dive->number = atoi(data[0]);
+	state.cur_dive->number = atoi(data[0]);
 
-	cur_dive->when = (time_t)(atol(data[1]));
+	state.cur_dive->when = (time_t)(atol(data[1]));
 
 	if (data[4])
-		utf8_string(data[4], &cur_dive->notes);
+		utf8_string(data[4], &state.cur_dive->notes);
 
 	/* data[5] should have information on Units used, but I cannot
 	 * parse it at all based on the sample log I have received. The
@@ -2677,68 +3177,68 @@ extern int cobalt_dive(void *param, int columns, char **data, char **column)
 
 	/* Cobalt stores the pressures, not the depth */
 	if (data[6])
-		cur_dive->dc.maxdepth.mm = atoi(data[6]);
+		state.cur_dive->dc.maxdepth.mm = atoi(data[6]);
 
 	if (data[7])
-		cur_dive->dc.duration.seconds = atoi(data[7]);
+		state.cur_dive->dc.duration.seconds = atoi(data[7]);
 
 	if (data[8])
-		cur_dive->dc.surface_pressure.mbar = atoi(data[8]);
+		state.cur_dive->dc.surface_pressure.mbar = atoi(data[8]);
 	/*
 	 * TODO: the deviceid hash should be calculated here.
 	 */
 	settings_start();
 	dc_settings_start();
 	if (data[9]) {
-		utf8_string(data[9], &cur_settings.dc.serial_nr);
-		cur_settings.dc.deviceid = atoi(data[9]);
-		cur_settings.dc.model = strdup("Cobalt import");
+		utf8_string(data[9], &state.cur_settings.dc.serial_nr);
+		state.cur_settings.dc.deviceid = atoi(data[9]);
+		state.cur_settings.dc.model = strdup("Cobalt import");
 	}
 
 	dc_settings_end();
 	settings_end();
 
 	if (data[9]) {
-		cur_dive->dc.deviceid = atoi(data[9]);
-		cur_dive->dc.model = strdup("Cobalt import");
+		state.cur_dive->dc.deviceid = atoi(data[9]);
+		state.cur_dive->dc.model = strdup("Cobalt import");
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_cylinder_template, cur_dive->number);
+	snprintf(get_buffer, sizeof(get_buffer) - 1, get_cylinder_template, state.cur_dive->number);
 	retval = sqlite3_exec(handle, get_buffer, &cobalt_cylinders, 0, &err);
 	if (retval != SQLITE_OK) {
 		fprintf(stderr, "%s", translate("gettextFromC", "Database query cobalt_cylinders failed.\n"));
 		return 1;
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_buddy_template, cur_dive->number);
+	snprintf(get_buffer, sizeof(get_buffer) - 1, get_buddy_template, state.cur_dive->number);
 	retval = sqlite3_exec(handle, get_buffer, &cobalt_buddies, 0, &err);
 	if (retval != SQLITE_OK) {
 		fprintf(stderr, "%s", translate("gettextFromC", "Database query cobalt_buddies failed.\n"));
 		return 1;
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_visibility_template, cur_dive->number);
+	snprintf(get_buffer, sizeof(get_buffer) - 1, get_visibility_template, state.cur_dive->number);
 	retval = sqlite3_exec(handle, get_buffer, &cobalt_visibility, 0, &err);
 	if (retval != SQLITE_OK) {
 		fprintf(stderr, "%s", translate("gettextFromC", "Database query cobalt_visibility failed.\n"));
 		return 1;
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_location_template, cur_dive->number);
+	snprintf(get_buffer, sizeof(get_buffer) - 1, get_location_template, state.cur_dive->number);
 	retval = sqlite3_exec(handle, get_buffer, &cobalt_location, 0, &err);
 	if (retval != SQLITE_OK) {
 		fprintf(stderr, "%s", translate("gettextFromC", "Database query cobalt_location failed.\n"));
 		return 1;
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_site_template, cur_dive->number);
+	snprintf(get_buffer, sizeof(get_buffer) - 1, get_site_template, state.cur_dive->number);
 	retval = sqlite3_exec(handle, get_buffer, &cobalt_location, 0, &err);
 	if (retval != SQLITE_OK) {
 		fprintf(stderr, "%s", translate("gettextFromC", "Database query cobalt_location (site) failed.\n"));
 		return 1;
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_profile_template, cur_dive->number);
+	snprintf(get_buffer, sizeof(get_buffer) - 1, get_profile_template, state.cur_dive->number);
 	retval = sqlite3_exec(handle, get_buffer, &cobalt_profile_sample, 0, &err);
 	if (retval != SQLITE_OK) {
 		fprintf(stderr, "%s", translate("gettextFromC", "Database query cobalt_profile_sample failed.\n"));
@@ -2807,15 +3307,15 @@ int parse_dlf_buffer(unsigned char *buffer, size_t size)
 	dive_start();
 	divecomputer_start();
 
-	cur_dc->model = strdup("DLF import");
+	state.cur_dc->model = strdup("DLF import");
 	// (ptr[7] << 8) + ptr[6] Is "Serial"
 	snprintf(serial, sizeof(serial), "%d", (ptr[7] << 8) + ptr[6]);
-	cur_dc->serial = strdup(serial);
+	state.cur_dc->serial = strdup(serial);
 	// Dive start time in seconds since 2000-01-01 12:00 UTC +0
-	cur_dc->when = (ptr[11] << 24) + (ptr[10] << 16) + (ptr[9] << 8) + ptr[8] + 946728000;
-	cur_dive->when = cur_dc->when;
+	state.cur_dc->when = (ptr[11] << 24) + (ptr[10] << 16) + (ptr[9] << 8) + ptr[8] + 946728000;
+	state.cur_dive->when = state.cur_dc->when;
 
-	cur_dc->duration.seconds = ((ptr[14] & 0xFE) << 16) + (ptr[13] << 8) + ptr[12];
+	state.cur_dc->duration.seconds = ((ptr[14] & 0xFE) << 16) + (ptr[13] << 8) + ptr[12];
 
 	// ptr[14] >> 1 is scrubber used in %
 
@@ -2823,37 +3323,37 @@ int parse_dlf_buffer(unsigned char *buffer, size_t size)
 	switch((ptr[15] & 0x30) >> 3) {
 	case 0: // unknown
 	case 1:
-		cur_dc->divemode = OC;
+		state.cur_dc->divemode = OC;
 		break;
 	case 2:
-		cur_dc->divemode = CCR;
+		state.cur_dc->divemode = CCR;
 		break;
 	case 3:
-		cur_dc->divemode = CCR; // mCCR
+		state.cur_dc->divemode = CCR; // mCCR
 		break;
 	case 4:
-		cur_dc->divemode = FREEDIVE;
+		state.cur_dc->divemode = FREEDIVE;
 		break;
 	case 5:
-		cur_dc->divemode = OC; // Gauge
+		state.cur_dc->divemode = OC; // Gauge
 		break;
 	case 6:
-		cur_dc->divemode = PSCR; // ASCR
+		state.cur_dc->divemode = PSCR; // ASCR
 		break;
 	case 7:
-		cur_dc->divemode = PSCR;
+		state.cur_dc->divemode = PSCR;
 		break;
 	}
 
-	cur_dc->maxdepth.mm = ((ptr[21] << 8) + ptr[20]) * 10;
-	cur_dc->surface_pressure.mbar = ((ptr[25] << 8) + ptr[24]) / 10;
+	state.cur_dc->maxdepth.mm = ((ptr[21] << 8) + ptr[20]) * 10;
+	state.cur_dc->surface_pressure.mbar = ((ptr[25] << 8) + ptr[24]) / 10;
 
 	/* Done with parsing what we know about the dive header */
 	ptr += 32;
 
 	// We're going to interpret ppO2 saved as a sensor value in these modes.
-	if (cur_dc->divemode == CCR || cur_dc->divemode == PSCR)
-		cur_dc->no_o2sensors = 1;
+	if (state.cur_dc->divemode == CCR || state.cur_dc->divemode == PSCR)
+		state.cur_dc->no_o2sensors = 1;
 
 	while (ptr < buffer + size) {
 		time = ((ptr[0] >> 4) & 0x0f) +
@@ -2864,23 +3364,23 @@ int parse_dlf_buffer(unsigned char *buffer, size_t size)
 		case 0:
 			/* Regular sample */
 			sample_start();
-			cur_sample->time.seconds = time;
-			cur_sample->depth.mm = ((ptr[5] << 8) + ptr[4]) * 10;
+			state.cur_sample->time.seconds = time;
+			state.cur_sample->depth.mm = ((ptr[5] << 8) + ptr[4]) * 10;
 			// Crazy precision on these stored values...
 			// Only store value if we're in CCR/PSCR mode,
 			// because we rather calculate ppo2 our selfs.
-			if (cur_dc->divemode == CCR || cur_dc->divemode == PSCR)
-				cur_sample->o2sensor[0].mbar = ((ptr[7] << 8) + ptr[6]) / 10;
+			if (state.cur_dc->divemode == CCR || state.cur_dc->divemode == PSCR)
+				state.cur_sample->o2sensor[0].mbar = ((ptr[7] << 8) + ptr[6]) / 10;
 			// NDL in minutes, 10 bit
-			cur_sample->ndl.seconds = (((ptr[9] & 0x03) << 8) + ptr[8]) * 60;
+			state.cur_sample->ndl.seconds = (((ptr[9] & 0x03) << 8) + ptr[8]) * 60;
 			// TTS in minutes, 10 bit
-			cur_sample->tts.seconds = (((ptr[10] & 0x0F) << 6) + (ptr[9] >> 2)) * 60;
+			state.cur_sample->tts.seconds = (((ptr[10] & 0x0F) << 6) + (ptr[9] >> 2)) * 60;
 			// Temperature in 1/10 C, 10 bit signed
-			cur_sample->temperature.mkelvin = ((ptr[11] & 0x20) ? -1 : 1)  * (((ptr[11] & 0x1F) << 4) + (ptr[10] >> 4)) * 100 + ZERO_C_IN_MKELVIN;
+			state.cur_sample->temperature.mkelvin = ((ptr[11] & 0x20) ? -1 : 1)  * (((ptr[11] & 0x1F) << 4) + (ptr[10] >> 4)) * 100 + ZERO_C_IN_MKELVIN;
 			// ptr[11] & 0xF0 is unknown, and always 0xC in all checked files
-			cur_sample->stopdepth.mm = ((ptr[13] << 8) + ptr[12]) * 10;
-			if (cur_sample->stopdepth.mm)
-				cur_sample->in_deco = true;
+			state.cur_sample->stopdepth.mm = ((ptr[13] << 8) + ptr[12]) * 10;
+			if (state.cur_sample->stopdepth.mm)
+				state.cur_sample->in_deco = true;
 			//ptr[14] is helium content, always zero?
 			//ptr[15] is setpoint, always zero?
 			sample_end();
@@ -2940,17 +3440,17 @@ int parse_dlf_buffer(unsigned char *buffer, size_t size)
 				cur_event.value = ptr[7] << 8 ^ ptr[6];
 
 				found = false;
-				for (i = 0; i < cur_cylinder_index; ++i) {
-					if (cur_dive->cylinder[i].gasmix.o2.permille == ptr[6] * 10 && cur_dive->cylinder[i].gasmix.he.permille == ptr[7] * 10)
+				for (i = 0; i < state.cur_cylinder_index; ++i) {
+					if (state.cur_dive->cylinder[i].gasmix.o2.permille == ptr[6] * 10 && state.cur_dive->cylinder[i].gasmix.he.permille == ptr[7] * 10)
 						found = true;
 						break;
 				}
 				if (!found) {
 					cylinder_start();
-					cur_dive->cylinder[cur_cylinder_index].gasmix.o2.permille = ptr[6] * 10;
-					cur_dive->cylinder[cur_cylinder_index].gasmix.he.permille = ptr[7] * 10;
+					state.cur_dive->cylinder[state.cur_cylinder_index].gasmix.o2.permille = ptr[6] * 10;
+					state.cur_dive->cylinder[state.cur_cylinder_index].gasmix.he.permille = ptr[7] * 10;
 					cylinder_end();
-					cur_event.gas.index = cur_cylinder_index;
+					cur_event.gas.index = state.cur_cylinder_index;
 				} else {
 					cur_event.gas.index = i;
 				}
@@ -3124,25 +3624,35 @@ static struct xslt_files {
 	  { NULL, }
   };
 
+static struct xslt_files *find_xslt_file(xmlNode *root_element)
+{
+	struct xslt_files *info;
+
+	for (info = xslt_files; info->root; info++) {
+		if (strcasecmp(root_element->name, info->root))
+			continue;
+		if (info->attribute == NULL || xmlHasProp(root_element, info->attribute))
+			return info;
+	}
+	return NULL;
+}
+
+/* whether the root element is one we have a stylesheet for */
+static bool needs_xslt_transform(xmlNode *root_element)
+{
+	return find_xslt_file(root_element) != NULL;
+}
+
 static xmlDoc *test_xslt_transforms(xmlDoc *doc, const char **params)
 {
-	struct xslt_files *info = xslt_files;
+	struct xslt_files *info;
 	xmlDoc *transformed;
 	xsltStylesheetPtr xslt = NULL;
 	xmlNode *root_element = xmlDocGetRootElement(doc);
 	char *attribute;
 
-	while (info->root) {
-		if ((strcasecmp(root_element->name, info->root) == 0)) {
-			if (info->attribute == NULL)
-				break;
-			else if (xmlGetProp(root_element, info->attribute) != NULL)
-				break;
-		}
-		info++;
-	}
-
-	if (info->root) {
+	info = find_xslt_file(root_element);
+	if (info) {
 		attribute = xmlGetProp(xmlFirstElementChild(root_element), "name");
 		if (attribute) {
 			if (strcasecmp(attribute, "subsurface") == 0) {
@@ -12,6 +12,7 @@
 #include "divelist.h"
 #include "planner.h"
 #include "gettext.h"
+#include "deco.h"
 #include "libdivecomputer/parser.h"
 
 #define TIMESTEP 3 /* second */
@@ -127,6 +128,10 @@ double interpolate_transition(struct dive *dive, duration_t t0, duration_t t1, d
 	int j;
 	double tissue_tolerance = 0.0;
 
+	/* at constant depth there is nothing to interpolate */
+	if (d0.mm == d1.mm && t1.seconds > t0.seconds)
+		return add_segments(depth_to_mbar(d0.mm, dive) / 1000.0, gasmix, 1, t1.seconds - t0.seconds, po2.mbar, dive, prefs.bottomsac);
+
 	for (j = t0.seconds; j < t1.seconds; j++) {
 		int depth = interpolate(d0.mm, d1.mm, j - t0.seconds, t1.seconds - t0.seconds);
 		tissue_tolerance = add_segment(depth_to_mbar(depth, dive) / 1000.0, gasmix, 1, po2.mbar, dive, prefs.bottomsac);
@@ -134,6 +139,47 @@ double interpolate_transition(struct dive *dive, duration_t t0, duration_t t1, d
 	return tissue_tolerance;
 }
 
+/*
+ * The cache handed to plan() holds the tissue state at the end of the
+ * manually entered part of the dive, preceded by a checksum of everything
+ * that state depends on: the waypoints, the gases breathed, the surface
+ * conditions and the settings that influence the tissue loading. As long
+ * as those don't change, replanning (say with different ascent rates, GF
+ * high or last stop depth) skips simulating the bottom phase.
+ */
+#define PLAN_CACHE_KEY_SIZE 20
+
+static void plan_cache_key(unsigned char *key, struct dive *dive)
+{
+	SHA_CTX ctx;
+	struct divecomputer *dc = &dive->dc;
+	int i, surface_pressure = get_surface_pressure_in_mbar(dive, true);
+	duration_t t0 = {};
+	struct gasmix gas;
+
+	SHA1_Init(&ctx);
+	deco_loading_checksum(&ctx);
+	SHA1_Update(&ctx, &dive->when, sizeof(dive->when));
+	SHA1_Update(&ctx, &surface_pressure, sizeof(surface_pressure));
+	SHA1_Update(&ctx, &dive->salinity, sizeof(dive->salinity));
+	SHA1_Update(&ctx, &dc->divemode, sizeof(dc->divemode));
+	/* the loop gas of a PSCR, here and in the dives before */
+	SHA1_Update(&ctx, &prefs.bottomsac, sizeof(prefs.bottomsac));
+	SHA1_Update(&ctx, &prefs.decosac, sizeof(prefs.decosac));
+	SHA1_Update(&ctx, &prefs.o2consumption, sizeof(prefs.o2consumption));
+	SHA1_Update(&ctx, &prefs.pscr_ratio, sizeof(prefs.pscr_ratio));
+	for (i = 0; i < dc->samples; i++) {
+		struct sample *sample = dc->sample + i;
+		int data[3] = { sample->time.seconds, sample->depth.mm, sample->setpoint.mbar };
+
+		get_gas_at_time(dive, dc, t0, &gas);
+		SHA1_Update(&ctx, data, sizeof(data));
+		SHA1_Update(&ctx, &gas, sizeof(gas));
+		t0 = sample->time;
+	}
+	SHA1_Final(key, &ctx);
+}
+
 /* returns the tissue tolerance at the end of this (partial) dive */
 double tissue_at_end(struct dive *dive, char **cached_datap)
 {
@@ -144,18 +190,27 @@ double tissue_at_end(struct dive *dive, char **cached_datap)
 	duration_t t0 = {}, t1 = {};
 	double tissue_tolerance;
 	struct gasmix gas;
+	unsigned char key[PLAN_CACHE_KEY_SIZE];
+	char *state;
 
 	if (!dive)
 		return 0.0;
-	if (*cached_datap) {
-		tissue_tolerance = restore_deco_state(*cached_datap);
-	} else {
-		tissue_tolerance = init_decompression(dive);
-		cache_deco_state(tissue_tolerance, cached_datap);
+	plan_cache_key(key, dive);
+	if (*cached_datap && !memcmp(*cached_datap, key, PLAN_CACHE_KEY_SIZE)) {
+		restore_deco_state(*cached_datap + PLAN_CACHE_KEY_SIZE);
+		return deco_tissue_tolerance(dive);
 	}
+	if (!*cached_datap)
+		*cached_datap = malloc(PLAN_CACHE_KEY_SIZE + DECO_STATE_SIZE);
+	memcpy(*cached_datap, key, PLAN_CACHE_KEY_SIZE);
+	state = *cached_datap + PLAN_CACHE_KEY_SIZE;
+
+	tissue_tolerance = init_decompression(dive);
 	dc = &dive->dc;
-	if (!dc->samples)
+	if (!dc->samples) {
+		cache_deco_state(tissue_tolerance, &state);
 		return tissue_tolerance;
+	}
 	psample = sample = dc->sample;
 
 	for (i = 0; i < dc->samples; i++, sample++) {
@@ -167,6 +222,7 @@ double tissue_at_end(struct dive *dive, char **cached_datap)
 		psample = sample;
 		t0 = t1;
 	}
+	cache_deco_state(tissue_tolerance, &state);
 	return tissue_tolerance;
 }
 
@@ -817,7 +873,7 @@ bool trial_ascent(int trial_depth, int stoplevel, int avg_depth, int bottom_time
 {
 
 	bool clear_to_ascend = true;
-	char *trial_cache = NULL;
+	static char *trial_cache = NULL;
 
 	cache_deco_state(tissue_tolerance, &trial_cache);
 	while (trial_depth > stoplevel) {
@@ -838,6 +894,52 @@ bool trial_ascent(int trial_depth, int stoplevel, int avg_depth, int bottom_time
 	return clear_to_ascend;
 }
 
+/*
+ * Find how long we have to wait at a deco stop before the ascent to the
+ * next stop level is clear. The depth doesn't change during the stop, so the
+ * tissue loading for any stop length is one add_segments() call: we bracket
+ * the stop time by doubling it and then bisect, instead of trying the ascent
+ * after every single minute. Only the trial ascents are done in small steps,
+ * as that's where we may cross the ceiling.
+ *
+ * Returns the stop time in seconds, a multiple of DECOTIMESTEP of at most
+ * max_time, and leaves the tissues at the end of the stop.
+ */
+static int deco_stop_time(int depth, int stoplevel, int avg_depth, int bottom_time, double *tissue_tolerance,
+			  struct gasmix *gasmix, int po2, double surface_pressure, int max_time)
+{
+	static char *stop_cache = NULL;
+	int low = 0, high = DECOTIMESTEP;
+	double pressure = depth_to_mbar(depth, &displayed_dive) / 1000.0;
+	double tolerance;
+
+	cache_deco_state(*tissue_tolerance, &stop_cache);
+	/* we were not clear to ascend without a stop, so we only need to find an upper bound */
+	while (high < max_time) {
+		restore_deco_state(stop_cache);
+		tolerance = add_segments(pressure, gasmix, DECOTIMESTEP, high / DECOTIMESTEP, po2, &displayed_dive, prefs.decosac);
+		if (trial_ascent(depth, stoplevel, avg_depth, bottom_time, tolerance, gasmix, po2, surface_pressure))
+			break;
+		low = high;
+		high *= 2;
+	}
+	if (high > max_time)
+		high = max_time;
+	while (high - low > DECOTIMESTEP) {
+		int mid = low + (high - low) / DECOTIMESTEP / 2 * DECOTIMESTEP;
+
+		restore_deco_state(stop_cache);
+		tolerance = add_segments(pressure, gasmix, DECOTIMESTEP, mid / DECOTIMESTEP, po2, &displayed_dive, prefs.decosac);
+		if (trial_ascent(depth, stoplevel, avg_depth, bottom_time, tolerance, gasmix, po2, surface_pressure))
+			high = mid;
+		else
+			low = mid;
+	}
+	restore_deco_state(stop_cache);
+	*tissue_tolerance = add_segments(pressure, gasmix, DECOTIMESTEP, high / DECOTIMESTEP, po2, &displayed_dive, prefs.decosac);
+	return high;
+}
+
 bool enough_gas(int current_cylinder)
 {
 	cylinder_t *cyl;
@@ -1047,8 +1149,32 @@ int plan(struct diveplan *diveplan, char **cached_datap, bool is_planner, bool s
 
 		--stopidx;
 
+		/* Without oxygen breaks the gas doesn't change during the stop,
+		 * so we can search for the stop length directly */
+		if (!prefs.doo2breaks &&
+		    !trial_ascent(depth, stoplevels[stopidx], avg_depth, bottom_time, tissue_tolerance,
+				  &displayed_dive.cylinder[current_cylinder].gasmix, po2, diveplan->surface_pressure / 1000.0)) {
+			int max_time = clock < 48 * 3600 ? (48 * 3600 - clock + DECOTIMESTEP - 1) / DECOTIMESTEP * DECOTIMESTEP : DECOTIMESTEP;
+			int stoptime;
+
+			if (!stopping) {
+				/* The last segment was an ascend segment.
+				 * Add a waypoint for start of this deco stop */
+				plan_add_segment(diveplan, clock - previous_point_time, depth, gas, po2, false);
+				previous_point_time = clock;
+				stopping = true;
+			}
+			stoptime = deco_stop_time(depth, stoplevels[stopidx], avg_depth, bottom_time, &tissue_tolerance,
+						  &displayed_dive.cylinder[current_cylinder].gasmix, po2,
+						  diveplan->surface_pressure / 1000.0, max_time);
+			clock += stoptime;
+			/* Finish infinite deco */
+			if (stoptime == max_time && depth >= 6000)
+				error = LONGDECO;
+		}
+
 		/* Save the current state and try to ascend to the next stopdepth */
-		while (1) {
+		while (prefs.doo2breaks) {
 			/* Check if ascending to next stop is clear, go back and wait if we hit the ceiling on the way */
 			if (trial_ascent(depth, stoplevels[stopidx], avg_depth, bottom_time, tissue_tolerance,
 					 &displayed_dive.cylinder[current_cylinder].gasmix, po2, diveplan->surface_pressure / 1000.0))
@@ -1118,6 +1244,172 @@ int plan(struct diveplan *diveplan, char **cached_datap, bool is_planner, bool s
 	return error;
 }
 
+/* the runtime of the last manually entered waypoint */
+static int last_entered_time(struct diveplan *diveplan)
+{
+	struct divedatapoint *dp;
+	int time = 0;
+
+	for (dp = diveplan->dp; dp; dp = dp->next) {
+		if (dp->entered && dp->time > time)
+			time = dp->time;
+	}
+	return time;
+}
+
+static void get_plan_result(struct diveplan *diveplan, struct dive *dive, int error, struct plan_variation_result *result)
+{
+	int i;
+
+	memset(result, 0, sizeof(*result));
+	result->error = error;
+	result->runtime = dive->dc.duration;
+	result->tts.seconds = dive->dc.duration.seconds - last_entered_time(diveplan);
+	for (i = 0; i < MAX_CYLINDERS; i++)
+		result->gas_used.mliter += dive->cylinder[i].gas_used.mliter;
+	/* add_plan_to_notes() has updated those */
+	result->cns = dive->maxcns;
+	result->otu = dive->otu;
+}
+
+/*
+ * The variations we show next to a plan: five minutes less and more
+ * bottom time, the common gradient factor pairs and no deco gases.
+ */
+int get_default_plan_variations(struct diveplan *diveplan, struct plan_variation *variations)
+{
+	static const short gf_pairs[][2] = { { 30, 70 }, { 50, 80 }, { 100, 100 } };
+	struct divedatapoint *dp, *last = NULL, *prev = NULL;
+	bool have_deco_gas = false;
+	int i, nr = 0;
+
+	for (dp = diveplan->dp; dp; dp = dp->next) {
+		if (dp->time == 0) {
+			have_deco_gas = true;
+		} else if (dp->entered) {
+			prev = last;
+			last = dp;
+		}
+	}
+	if (!last)
+		return 0;
+	memset(variations, 0, MAX_PLAN_VARIATIONS * sizeof(*variations));
+	for (i = 0; i < MAX_PLAN_VARIATIONS; i++) {
+		variations[i].gflow = diveplan->gflow;
+		variations[i].gfhigh = diveplan->gfhigh;
+	}
+	if (last->time - (prev ? prev->time : 0) > 5 * 60)
+		variations[nr++].bottomtime_delta = -5 * 60;
+	variations[nr++].bottomtime_delta = 5 * 60;
+	for (i = 0; i < (int)(sizeof(gf_pairs) / sizeof(gf_pairs[0])); i++) {
+		if (gf_pairs[i][0] == diveplan->gflow && gf_pairs[i][1] == diveplan->gfhigh)
+			continue;
+		variations[nr].gflow = gf_pairs[i][0];
+		variations[nr++].gfhigh = gf_pairs[i][1];
+	}
+	/* last, as it shares the bottom phase with the plan itself */
+	if (have_deco_gas)
+		variations[nr++].bottom_gas_only = true;
+	return nr;
+}
+
+/* build a plan that only has the user input of diveplan, modified as requested */
+static void copy_plan_variation(struct diveplan *diveplan, const struct plan_variation *variation, struct diveplan *copy)
+{
+	struct divedatapoint *dp, *ndp, *last = NULL, **tail = &copy->dp;
+
+	*copy = *diveplan;
+	copy->dp = NULL;
+	copy->gflow = variation->gflow;
+	copy->gfhigh = variation->gfhigh;
+	for (dp = diveplan->dp; dp; dp = dp->next) {
+		if (dp->time == 0 ? variation->bottom_gas_only : !dp->entered)
+			continue;
+		ndp = malloc(sizeof(*ndp));
+		*ndp = *dp;
+		ndp->next = NULL;
+		*tail = ndp;
+		tail = &ndp->next;
+		if (ndp->entered)
+			last = ndp;
+	}
+	if (last)
+		last->time += variation->bottomtime_delta;
+}
+
+/*
+ * Plan each variation of the user input in diveplan. This leaves the last
+ * variation in displayed_dive, so callers plan the dive itself afterwards.
+ */
+void plan_variations(struct diveplan *diveplan, char **cached_datap, const struct plan_variation *variations,
+		     struct plan_variation_result *results, int nr)
+{
+	struct diveplan copy;
+	int i, error;
+
+	for (i = 0; i < nr; i++) {
+		copy_plan_variation(diveplan, variations + i, &copy);
+		error = plan(&copy, cached_datap, true, false);
+		get_plan_result(&copy, &displayed_dive, error, results + i);
+		free(displayed_dive.notes);
+		displayed_dive.notes = NULL;
+		free_dps(&copy);
+	}
+}
+
+static int add_variation_row(char *buffer, int size, const char *name, const struct plan_variation_result *result)
+{
+	const char *unit;
+	double volume = get_volume_units(result->gas_used.mliter, NULL, &unit);
+
+	if (result->error)
+		return snprintf(buffer, size, "<tr><td>%s</td><td colspan='5' style='padding-left: 10px;'>%s</td></tr>", name,
+				translate("gettextFromC", "Decompression calculation aborted due to excessive time"));
+	return snprintf(buffer, size, "<tr><td>%s</td><td style='padding-left: 10px;'>%3dmin</td><td style='padding-left: 10px;'>%3dmin</td>"
+			"<td style='padding-left: 10px;'>%.0f%s</td><td style='padding-left: 10px;'>%i%%</td><td style='padding-left: 10px;'>%i</td></tr>",
+			name, (result->runtime.seconds + 30) / 60, (result->tts.seconds + 30) / 60, volume, unit, result->cns, result->otu);
+}
+
+/* append a table comparing the plan in dive with its variations to the notes */
+void add_plan_variations_to_notes(struct diveplan *diveplan, struct dive *dive, const struct plan_variation *variations,
+				  const struct plan_variation_result *results, int nr)
+{
+	char buffer[10000], name[100];
+	struct plan_variation_result result;
+	int i, len;
+	char *notes;
+
+	if (!nr || !dive->notes)
+		return;
+	len = snprintf(buffer, sizeof(buffer), "<div><br><b>%s</b><br><table><thead><tr><th></th>",
+		       translate("gettextFromC", "Plan variations"));
+	len += snprintf(buffer + len, sizeof(buffer) - len, "<th style='padding-left: 10px;'>%s</th><th style='padding-left: 10px;'>%s</th>"
+			"<th style='padding-left: 10px;'>%s</th><th style='padding-left: 10px;'>%s</th><th style='padding-left: 10px;'>%s</th></tr></thead><tbody>",
+			translate("gettextFromC", "runtime"), translate("gettextFromC", "TTS"), translate("gettextFromC", "gas used"),
+			translate("gettextFromC", "CNS"), translate("gettextFromC", "OTU"));
+	get_plan_result(diveplan, dive, 0, &result);
+	len += add_variation_row(buffer + len, sizeof(buffer) - len, translate("gettextFromC", "this plan"), &result);
+	for (i = 0; i < nr && len < (int)sizeof(buffer); i++) {
+		const struct plan_variation *variation = variations + i;
+
+		if (variation->bottomtime_delta)
+			snprintf(name, sizeof(name), translate("gettextFromC", "bottom time %+dmin"), variation->bottomtime_delta / 60);
+		else if (variation->bottom_gas_only)
+			snprintf(name, sizeof(name), "%s", translate("gettextFromC", "without deco gases"));
+		else
+			snprintf(name, sizeof(name), translate("gettextFromC", "GF %d/%d"), variation->gflow, variation->gfhigh);
+		len += add_variation_row(buffer + len, sizeof(buffer) - len, name, results + i);
+	}
+	if (len < (int)sizeof(buffer))
+		snprintf(buffer + len, sizeof(buffer) - len, "</tbody></table></div>");
+
+	notes = malloc(strlen(dive->notes) + strlen(buffer) + 1);
+	strcpy(notes, dive->notes);
+	strcat(notes, buffer);
+	free(dive->notes);
+	dive->notes = notes;
+}
+
 /*
  * Get a value in tenths (so "10.2" == 102, "9" = 90)
  *
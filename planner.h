@@ -22,6 +22,29 @@ extern int get_gasidx(struct dive *dive, struct gasmix *mix);
 extern bool diveplan_empty(struct diveplan *diveplan);
 
 extern void free_dps(struct diveplan *diveplan);
+
+/* a variation of a dive plan, to be compared against the plan itself */
+#define MAX_PLAN_VARIATIONS 8
+
+struct plan_variation {
+	int bottomtime_delta;	/* seconds added to the last entered segment */
+	short gflow, gfhigh;
+	bool bottom_gas_only;	/* don't use the deco gases */
+};
+
+struct plan_variation_result {
+	int error;
+	duration_t runtime;
+	duration_t tts;		/* time to surface from the last entered waypoint */
+	volume_t gas_used;
+	int cns, otu;
+};
+
+extern int get_default_plan_variations(struct diveplan *diveplan, struct plan_variation *variations);
+extern void plan_variations(struct diveplan *diveplan, char **cached_datap, const struct plan_variation *variations,
+			    struct plan_variation_result *results, int nr);
+extern void add_plan_variations_to_notes(struct diveplan *diveplan, struct dive *dive, const struct plan_variation *variations,
+					 const struct plan_variation_result *results, int nr);
 extern struct dive *planned_dive;
 extern char *cache_data;
 extern const char *disclaimer;
@@ -41,6 +41,7 @@ struct preferences {
 	short calcndltts;
 	short gflow;
 	short gfhigh;
+	char *gf_overlay; // extra "low/high" gradient factor pairs to show the ceiling for
 	int animation_speed;
 	bool gf_low_at_maxdepth;
 	bool show_ccr_setpoint;
@@ -78,6 +79,7 @@ struct preferences {
 	bool display_runtime;
 	bool display_duration;
 	bool display_transitions;
+	bool display_variations;
 	bool recreational_mode;
 	bool safetystop;
 	int bottomsac;
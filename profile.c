@@ -178,46 +178,65 @@ static int get_local_sac(struct plot_data *entry1, struct plot_data *entry2, str
 	return airuse / atm * 60 / duration;
 }
 
-static void analyze_plot_info_minmax_minute(struct plot_data *entry, struct plot_data *first, struct plot_data *last, int index)
+/*
+ * Minimum, maximum and average depth over the entries within
+ * 90 * (index + 1) seconds of each entry. The window only ever moves
+ * forward, so we keep a running sum of the depths and two queues of
+ * entry indices with increasing (minq) and decreasing (maxq) depths:
+ * the head of each queue is the minimum/maximum of the window, and on
+ * ties the earlier entry wins.
+ */
+static void analyze_plot_info_minmax_minute(struct plot_info *pi, int index, int *minq, int *maxq)
 {
-	struct plot_data *p = entry;
-	int time = entry->sec;
+	struct plot_data *entry = pi->entry;
 	int seconds = 90 * (index + 1);
-	struct plot_data *min, *max;
-	int avg, nr;
-
-	/* Go back 'seconds' in time */
-	while (p > first) {
-		if (p[-1].sec < time - seconds)
-			break;
-		p--;
-	}
+	int start = 0, end = 0, avg = 0;
+	int min_head = 0, min_tail = 0, max_head = 0, max_tail = 0;
+	int i;
 
-	/* Then go forward until we hit an entry past the time */
-	min = max = p;
-	avg = p->depth;
-	nr = 1;
-	while (++p < last) {
-		int depth = p->depth;
-		if (p->sec > time + seconds)
-			break;
-		avg += depth;
-		nr++;
-		if (depth < min->depth)
-			min = p;
-		if (depth > max->depth)
-			max = p;
+	for (i = 0; i < pi->nr; i++) {
+		int time = entry[i].sec;
+		int nr;
+
+		/* Drop the entries more than 'seconds' before this one.. */
+		while (start < i && entry[start].sec < time - seconds)
+			avg -= entry[start++].depth;
+
+		/* ..and add the ones up to 'seconds' after it */
+		while (end < pi->nr && (end <= i || entry[end].sec <= time + seconds)) {
+			int depth = entry[end].depth;
+
+			while (min_tail > min_head && entry[minq[min_tail - 1]].depth > depth)
+				min_tail--;
+			minq[min_tail++] = end;
+			while (max_tail > max_head && entry[maxq[max_tail - 1]].depth < depth)
+				max_tail--;
+			maxq[max_tail++] = end;
+			avg += depth;
+			end++;
+		}
+		while (minq[min_head] < start)
+			min_head++;
+		while (maxq[max_head] < start)
+			max_head++;
+
+		nr = end - start;
+		entry[i].min[index] = entry + minq[min_head];
+		entry[i].max[index] = entry + maxq[max_head];
+		entry[i].avg[index] = (avg + nr / 2) / nr;
 	}
-	entry->min[index] = min;
-	entry->max[index] = max;
-	entry->avg[index] = (avg + nr / 2) / nr;
 }
 
-static void analyze_plot_info_minmax(struct plot_data *entry, struct plot_data *first, struct plot_data *last)
+static void analyze_plot_info_minmax(struct plot_info *pi)
 {
-	analyze_plot_info_minmax_minute(entry, first, last, 0);
-	analyze_plot_info_minmax_minute(entry, first, last, 1);
-	analyze_plot_info_minmax_minute(entry, first, last, 2);
+	int *queue = malloc(2 * pi->nr * sizeof(int));
+
+	if (!queue)
+		return;
+	analyze_plot_info_minmax_minute(pi, 0, queue, queue + pi->nr);
+	analyze_plot_info_minmax_minute(pi, 1, queue, queue + pi->nr);
+	analyze_plot_info_minmax_minute(pi, 2, queue, queue + pi->nr);
+	free(queue);
 }
 
 static velocity_t velocity(int speed)
@@ -282,10 +301,7 @@ struct plot_info *analyze_plot_info(struct plot_info *pi)
 	}
 
 	/* One-, two- and three-minute minmax data */
-	for (i = 0; i < nr; i++) {
-		struct plot_data *entry = pi->entry + i;
-		analyze_plot_info_minmax(entry, pi->entry, pi->entry + nr);
-	}
+	analyze_plot_info_minmax(pi);
 
 	return pi;
 }
@@ -694,9 +710,14 @@ static void populate_cylinder_pressure_data(int idx, int start, int end, struct
 	}
 }
 
+/*
+ * The SAC rate of an entry is the average of the local SAC rates since
+ * 'last'. Keep their running sum over the entries 'last' .. 'sum_end'
+ * instead of adding them all up again for every entry.
+ */
 static void calculate_sac(struct dive *dive, struct plot_info *pi)
 {
-	int i = 0, last = 0;
+	int i = 0, last = 0, sum = 0, sum_end = 0;
 	struct plot_data *last_entry = NULL;
 
 	for (i = 0; i < pi->nr; i++) {
@@ -704,16 +725,18 @@ static void calculate_sac(struct dive *dive, struct plot_info *pi)
 		if (entry->sac)
 			continue;
 		if (!last_entry || last_entry->cylinderindex != entry->cylinderindex) {
-			last = i;
+			last = sum_end = i;
+			sum = 0;
 			last_entry = entry;
 			entry->sac = get_local_sac(entry, pi->entry + i + 1, dive);
 		} else {
-			int j;
-			entry->sac = 0;
-			for (j = last; j < i; j++)
-				entry->sac += get_local_sac(pi->entry + j, pi->entry + j + 1, dive);
-			entry->sac /= (i - last);
+			while (sum_end < i) {
+				sum += get_local_sac(pi->entry + sum_end, pi->entry + sum_end + 1, dive);
+				sum_end++;
+			}
+			entry->sac = sum / (i - last);
 			if (entry->sec - last_entry->sec >= SAC_WINDOW) {
+				sum -= get_local_sac(last_entry, last_entry + 1, dive);
 				last++;
 				last_entry = pi->entry + last;
 			}
@@ -832,12 +855,78 @@ static void calculate_ndl_tts(double tissue_tolerance, struct plot_data *entry,
 
 /* Let's try to do some deco calculations.
  */
-void calculate_deco_information(struct dive *dive, struct divecomputer *dc, struct plot_info *pi, bool print_mode)
+/*
+ * The per-tissue ceilings and saturations only show up in the tool tip,
+ * the tissue graph and the ceilings of all tissues. Tool tips aren't
+ * printed, so when printing we only need them for the other two.
+ */
+static bool want_tissue_data(bool print_mode)
 {
+	return !print_mode || prefs.percentagegraph || (prefs.calcceiling && prefs.calcalltissues);
+}
+
+/* The tissue data of all entries is allocated in one block, owned by the first entry */
+static void alloc_tissue_data(struct plot_info *pi)
+{
+	struct plot_tissue_data *tissue;
 	int i;
+
+	if (!pi->nr || pi->entry[0].tissue)
+		return;
+	tissue = calloc(pi->nr, sizeof(struct plot_tissue_data));
+	if (!tissue)
+		return;
+	for (i = 0; i < pi->nr; i++)
+		pi->entry[i].tissue = tissue + i;
+}
+
+static void free_plot_data(struct plot_data *entry)
+{
+	if (entry)
+		free(entry->tissue);
+	free(entry);
+}
+
+/*
+ * The gradient factor pairs the ceiling overlay should show, from prefs.gf_overlay
+ * ("30/70 50/80 100/100", separated by blanks or commas). Anything that doesn't
+ * parse ends the list.
+ */
+int get_gf_overlays(short gf[MAX_GF_OVERLAYS][2])
+{
+	const char *p = prefs.gf_overlay;
+	int nr = 0, low, high, len;
+
+	while (p && nr < MAX_GF_OVERLAYS && sscanf(p, " %d/%d%n", &low, &high, &len) == 2) {
+		p += len;
+		p += strspn(p, " ,;");
+		if (low < 1 || low > 150 || high < 1 || high > 150)
+			continue;
+		gf[nr][0] = low;
+		gf[nr][1] = high;
+		nr++;
+	}
+	return nr;
+}
+
+void calculate_deco_information(struct dive *dive, struct divecomputer *dc, struct plot_info *pi, bool print_mode)
+{
+	int i, k;
 	double surface_pressure = (dc->surface_pressure.mbar ? dc->surface_pressure.mbar : get_surface_pressure_in_mbar(dive, true)) / 1000.0;
 	double tissue_tolerance = 0;
 	int last_ndl_tts_calc_time = 0;
+	/* the ceiling overlay only evaluates the tolerance for its gradient
+	 * factors, the tissue loading is shared with the real calculation */
+	short gf[MAX_GF_OVERLAYS][2];
+	double gf_low_pressure[MAX_GF_OVERLAYS], gf_tolerance[MAX_GF_OVERLAYS];
+	int gf_overlays = get_gf_overlays(gf);
+
+	for (k = 0; k < gf_overlays; k++) {
+		gf_low_pressure[k] = gf_low_pressure_this_dive;
+		gf_tolerance[k] = 0;
+	}
+	if (want_tissue_data(print_mode))
+		alloc_tissue_data(pi);
 	for (i = 1; i < pi->nr; i++) {
 		struct plot_data *entry = pi->entry + i;
 		int j, t0 = (entry - 1)->sec, t1 = entry->sec;
@@ -855,6 +944,8 @@ void calculate_deco_information(struct dive *dive, struct divecomputer *dc, stru
 			double min_pressure = add_segment(depth_to_mbar(depth, dive) / 1000.0,
 							  &dive->cylinder[entry->cylinderindex].gasmix, time_stepsize, entry->o2pressure.mbar, dive, entry->sac);
 			tissue_tolerance = min_pressure;
+			for (k = 0; k < gf_overlays; k++)
+				gf_tolerance[k] = deco_tolerance_with_gf(dive, gf[k][0], gf[k][1], &gf_low_pressure[k]);
 			if (j - t0 < time_stepsize)
 				time_stepsize = j - t0;
 		}
@@ -862,10 +953,16 @@ void calculate_deco_information(struct dive *dive, struct divecomputer *dc, stru
 			entry->ceiling = (entry - 1)->ceiling;
 		else
 			entry->ceiling = deco_allowed_depth(tissue_tolerance, surface_pressure, dive, !prefs.calcceiling3m);
-		for (j = 0; j < 16; j++) {
+		for (k = 0; k < gf_overlays; k++) {
+			if (t0 == t1)
+				entry->gf_ceilings[k] = (entry - 1)->gf_ceilings[k];
+			else
+				entry->gf_ceilings[k] = deco_allowed_depth(gf_tolerance[k], surface_pressure, dive, !prefs.calcceiling3m);
+		}
+		for (j = 0; entry->tissue && j < 16; j++) {
 			double m_value = buehlmann_inertgas_a[j] + entry->ambpressure / buehlmann_inertgas_b[j];
-			entry->ceilings[j] = deco_allowed_depth(tolerated_by_tissue[j], surface_pressure, dive, 1);
-			entry->percentages[j] = tissue_inertgas_saturation[j] < entry->ambpressure ?
+			entry->tissue->ceilings[j] = deco_allowed_depth(tolerated_by_tissue[j], surface_pressure, dive, 1);
+			entry->tissue->percentages[j] = tissue_inertgas_saturation[j] < entry->ambpressure ?
 							tissue_inertgas_saturation[j] / entry->ambpressure * AMB_PERCENTAGE :
 							AMB_PERCENTAGE + (tissue_inertgas_saturation[j] - entry->ambpressure) / (m_value - entry->ambpressure) * (100.0 - AMB_PERCENTAGE);
 		}
@@ -1049,13 +1146,16 @@ static void debug_print_profiledata(struct plot_info *pi)
  * This also makes sure that we have extra empty events on both
  * sides, so that you can do end-points without having to worry
  * about it.
+ *
+ * Without 'deco' the ceiling, tissue and NDL/TTS information is
+ * left empty; the caller can fill it in later with init_decompression()
+ * and calculate_deco_information().
  */
-void create_plot_info_new(struct dive *dive, struct divecomputer *dc, struct plot_info *pi, bool fast)
+static void calculate_plot_info(struct dive *dive, struct divecomputer *dc, struct plot_info *pi, bool fast, bool deco, bool print_mode)
 {
 	int o2, he, o2max;
-	init_decompression(dive);
-	/* Create the new plot data */
-	free((void *)last_pi_entry_new);
+	if (deco)
+		init_decompression(dive);
 
 	get_dive_gas(dive, &o2, &he, &o2max);
 	if (he > 0) {
@@ -1066,7 +1166,7 @@ void create_plot_info_new(struct dive *dive, struct divecomputer *dc, struct plo
 		else
 			pi->dive_type = AIR;
 	}
-	last_pi_entry_new = populate_plot_entries(dive, dc, pi);
+	populate_plot_entries(dive, dc, pi);
 
 	check_gas_change_events(dive, dc, pi);   /* Populate the gas index from the gas change events */
 	check_setpoint_events(dive, dc, pi);     /* Populate setpoints */
@@ -1078,7 +1178,8 @@ void create_plot_info_new(struct dive *dive, struct divecomputer *dc, struct plo
 	}
 	fill_o2_values(dc, pi, dive);			 /* .. and insert the O2 sensor data having 0 values. */
 	calculate_sac(dive, pi);			 /* Calculate sac */
-	calculate_deco_information(dive, dc, pi, false); /* and ceiling information, using gradient factor values in Preferences) */
+	if (deco)
+		calculate_deco_information(dive, dc, pi, print_mode); /* and ceiling information, using gradient factor values in Preferences) */
 	calculate_gas_information_new(dive, pi);	 /* Calculate gas partial pressures */
 
 #ifdef DEBUG_GAS
@@ -1089,6 +1190,200 @@ void create_plot_info_new(struct dive *dive, struct divecomputer *dc, struct plo
 	analyze_plot_info(pi);
 }
 
+void create_plot_info_new(struct dive *dive, struct divecomputer *dc, struct plot_info *pi, bool fast, bool deco, bool print_mode)
+{
+	/* Create the new plot data */
+	free_plot_data(last_pi_entry_new);
+	calculate_plot_info(dive, dc, pi, fast, deco, print_mode);
+	last_pi_entry_new = pi->entry;
+}
+
+/*
+ * The plot info of the last few dives shown, so that going back to
+ * a dive doesn't have to calculate everything again. The key covers
+ * what's in the dive (see hash_dive()) and which of its dive computers
+ * it is, as well as the preferences and deco settings that go into the
+ * plot info, so an edit of the displayed dive that isn't saved to the
+ * dive list yet gets plot info of its own. Any change to the dive list
+ * invalidates all of it, as the deco of a dive depends on the dives
+ * before it.
+ *
+ * The plot data of an entry may still be shown after it was invalidated,
+ * so everything showing it holds on to it (see hold_plot_info()) until
+ * release_plot_info(), and create_plot_info_cached() only reuses (and
+ * frees) entries nobody holds. If every entry is held the cache grows.
+ */
+#define PLOT_INFO_CACHE_SIZE 8
+
+struct plot_info_cache_entry {
+	bool valid;
+	bool deco;
+	int users;
+	unsigned int lastuse;
+	unsigned char key[20];
+	struct plot_info pi;
+};
+
+static struct plot_info_cache_entry *plot_info_cache;
+static int plot_info_cache_size;
+static unsigned int plot_info_cache_use;
+
+static void plot_info_cache_key(unsigned char *key, struct dive *dive, struct divecomputer *dc)
+{
+	SHA_CTX ctx;
+	struct divecomputer *d = &dive->dc;
+	unsigned char content[20];
+	int nr = 0;
+
+	/* the position of the dive computer in the dive, the pointer changes with every copy */
+	while (d && d != dc) {
+		d = d->next;
+		nr++;
+	}
+	/* the fake dive computer of a dive without samples stands in for the selected one */
+	if (!d)
+		nr = -1 - dc_number;
+	hash_dive(dive, content);
+	SHA1_Init(&ctx);
+	SHA1_Update(&ctx, content, sizeof(content));
+	SHA1_Update(&ctx, &dive->id, sizeof(dive->id));
+	SHA1_Update(&ctx, &nr, sizeof(nr));
+	SHA1_Update(&ctx, &prefs.gflow, sizeof(prefs.gflow));
+	SHA1_Update(&ctx, &prefs.gfhigh, sizeof(prefs.gfhigh));
+	SHA1_Update(&ctx, &prefs.calcceiling3m, sizeof(prefs.calcceiling3m));
+	SHA1_Update(&ctx, &prefs.calcndltts, sizeof(prefs.calcndltts));
+	SHA1_Update(&ctx, &prefs.pp_graphs, sizeof(prefs.pp_graphs));
+	SHA1_Update(&ctx, &prefs.units, sizeof(prefs.units));
+	SHA1_Update(&ctx, &prefs.modpO2, sizeof(prefs.modpO2));
+	SHA1_Update(&ctx, &prefs.bottomsac, sizeof(prefs.bottomsac));
+	SHA1_Update(&ctx, &prefs.decosac, sizeof(prefs.decosac));
+	SHA1_Update(&ctx, &prefs.zoomed_plot, sizeof(prefs.zoomed_plot));
+	if (prefs.gf_overlay)
+		SHA1_Update(&ctx, prefs.gf_overlay, strlen(prefs.gf_overlay));
+	deco_config_checksum(&ctx);
+	SHA1_Final(key, &ctx);
+}
+
+static struct plot_info_cache_entry *find_plot_info(struct plot_info *pi)
+{
+	int i;
+
+	if (!pi->entry)
+		return NULL;
+	for (i = 0; i < plot_info_cache_size; i++) {
+		if (plot_info_cache[i].pi.entry == pi->entry)
+			return plot_info_cache + i;
+	}
+	return NULL;
+}
+
+/* An entry nobody holds, or a new one if there is none */
+static struct plot_info_cache_entry *plot_info_cache_slot(void)
+{
+	struct plot_info_cache_entry *entry, *slot = NULL;
+	int i, size;
+
+	/* reuse an invalidated entry, otherwise the least recently used one */
+	for (i = 0; i < plot_info_cache_size; i++) {
+		entry = plot_info_cache + i;
+		if (entry->users)
+			continue;
+		if (!slot || (slot->valid && (!entry->valid || entry->lastuse < slot->lastuse)))
+			slot = entry;
+	}
+	if (slot) {
+		free_plot_data(slot->pi.entry);
+		return slot;
+	}
+
+	size = plot_info_cache_size ? plot_info_cache_size * 2 : PLOT_INFO_CACHE_SIZE;
+	entry = realloc(plot_info_cache, size * sizeof(*entry));
+	if (!entry)
+		return NULL;
+	memset(entry + plot_info_cache_size, 0, (size - plot_info_cache_size) * sizeof(*entry));
+	slot = entry + plot_info_cache_size;
+	plot_info_cache = entry;
+	plot_info_cache_size = size;
+	return slot;
+}
+
+/*
+ * Like calculate_max_limits_new() and create_plot_info_new() for the given
+ * dive computer of the dive, but reusing the plot info from the
+ * last time this dive was shown if nothing changed. The deco information
+ * is left for calculate_plot_info_deco(); returns whether it is already
+ * there. The plot info stays around until the caller hands it back to
+ * release_plot_info().
+ */
+bool create_plot_info_cached(struct dive *dive, struct divecomputer *dc, struct plot_info *pi)
+{
+	unsigned char key[20];
+	struct plot_info_cache_entry *entry;
+	int i;
+
+	plot_info_cache_key(key, dive, dc);
+	for (i = 0; i < plot_info_cache_size; i++) {
+		entry = plot_info_cache + i;
+		if (entry->valid && !memcmp(entry->key, key, sizeof(key))) {
+			entry->lastuse = ++plot_info_cache_use;
+			entry->users++;
+			*pi = entry->pi;
+			return entry->deco;
+		}
+	}
+
+	*pi = calculate_max_limits_new(dive, dc);
+	entry = plot_info_cache_slot();
+	if (!entry)
+		return false;
+	calculate_plot_info(dive, dc, pi, false, false, false);
+	memcpy(entry->key, key, sizeof(key));
+	entry->pi = *pi;
+	entry->valid = true;
+	entry->deco = false;
+	entry->users = 1;
+	entry->lastuse = ++plot_info_cache_use;
+	return false;
+}
+
+/* Keep showing plot info from create_plot_info_cached() somewhere else, too */
+void hold_plot_info(struct plot_info *pi)
+{
+	struct plot_info_cache_entry *entry = find_plot_info(pi);
+
+	if (entry)
+		entry->users++;
+}
+
+/* Done showing plot info, which may or may not come from create_plot_info_cached() */
+void release_plot_info(struct plot_info *pi)
+{
+	struct plot_info_cache_entry *entry = find_plot_info(pi);
+
+	if (entry && entry->users)
+		entry->users--;
+}
+
+/* Fill in the deco information of a plot info created without it */
+void calculate_plot_info_deco(struct dive *dive, struct divecomputer *dc, struct plot_info *pi)
+{
+	struct plot_info_cache_entry *entry;
+
+	init_decompression(dive);
+	calculate_deco_information(dive, dc, pi, false);
+	entry = find_plot_info(pi);
+	if (entry && entry->valid)
+		entry->deco = true;
+}
+
+void invalidate_plot_info_cache(void)
+{
+	int i;
+
+	for (i = 0; i < plot_info_cache_size; i++)
+		plot_info_cache[i].valid = false;
+}
+
 struct divecomputer *select_dc(struct dive *dive)
 {
 	unsigned int max = number_of_computers(dive);
@@ -1200,11 +1495,11 @@ static void plot_string(struct plot_info *pi, struct plot_data *entry, struct me
 	if (entry->ceiling) {
 		depthvalue = get_depth_units(entry->ceiling, NULL, &depth_unit);
 		put_format(b, translate("gettextFromC", "Calculated ceiling %.0f%s\n"), depthvalue, depth_unit);
-		if (prefs.calcalltissues) {
+		if (prefs.calcalltissues && entry->tissue) {
 			int k;
 			for (k = 0; k < 16; k++) {
-				if (entry->ceilings[k]) {
-					depthvalue = get_depth_units(entry->ceilings[k], NULL, &depth_unit);
+				if (entry->tissue->ceilings[k]) {
+					depthvalue = get_depth_units(entry->tissue->ceilings[k], NULL, &depth_unit);
 					put_format(b, translate("gettextFromC", "Tissue %.0fmin: %.0f%s\n"), buehlmann_N2_t_halflife[k], depthvalue, depth_unit);
 				}
 			}
@@ -1222,16 +1517,36 @@ static void plot_string(struct plot_info *pi, struct plot_data *entry, struct me
 	strip_mb(b);
 }
 
-struct plot_data *get_plot_details_new(struct plot_info *pi, int time, struct membuffer *mb)
+/*
+ * The first plot entry at or after the given time, or the last one
+ * if the time is past the end of the dive. The entries are sorted
+ * by time, so this is a simple binary search.
+ */
+struct plot_data *get_plot_entry_at(struct plot_info *pi, int time)
 {
-	struct plot_data *entry = NULL;
-	int i;
+	int low = 0, high = pi->nr - 1;
 
-	for (i = 0; i < pi->nr; i++) {
-		entry = pi->entry + i;
-		if (entry->sec >= time)
-			break;
+	if (pi->nr <= 0)
+		return NULL;
+	while (low < high) {
+		int mid = (low + high) / 2;
+		if (pi->entry[mid].sec < time)
+			low = mid + 1;
+		else
+			high = mid;
 	}
+	return pi->entry + low;
+}
+
+void get_plot_details_string(struct plot_info *pi, struct plot_data *entry, struct membuffer *mb)
+{
+	plot_string(pi, entry, mb, pi->has_ndl);
+}
+
+struct plot_data *get_plot_details_new(struct plot_info *pi, int time, struct membuffer *mb)
+{
+	struct plot_data *entry = get_plot_entry_at(pi, time);
+
 	if (entry)
 		plot_string(pi, entry, mb, pi->has_ndl);
 	return (entry);
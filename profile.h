@@ -16,6 +16,17 @@ typedef enum {
 struct membuffer;
 struct divecomputer;
 struct plot_info;
+
+/* The per-tissue data of a plot entry. It is only calculated when
+ * something can show it, see calculate_deco_information() */
+struct plot_tissue_data {
+	int ceilings[16];
+	int percentages[16];
+};
+
+/* How many extra gradient factor pairs the ceiling can be shown for, see get_gf_overlays() */
+#define MAX_GF_OVERLAYS 4
+
 struct plot_data {
 	unsigned int in_deco : 1;
 	int cylinderindex;
@@ -30,8 +41,8 @@ struct plot_data {
 	/* Depth info */
 	int depth;
 	int ceiling;
-	int ceilings[16];
-	int percentages[16];
+	struct plot_tissue_data *tissue; /* NULL unless calculated */
+	int gf_ceilings[MAX_GF_OVERLAYS];
 	int ndl;
 	int tts;
 	int stoptime;
@@ -72,9 +83,19 @@ struct plot_info calculate_max_limits_new(struct dive *dive, struct divecomputer
 void compare_samples(struct plot_data *e1, struct plot_data *e2, char *buf, int bufsize, int sum);
 struct plot_data *populate_plot_entries(struct dive *dive, struct divecomputer *dc, struct plot_info *pi);
 struct plot_info *analyze_plot_info(struct plot_info *pi);
-void create_plot_info_new(struct dive *dive, struct divecomputer *dc, struct plot_info *pi, bool fast);
+void create_plot_info_new(struct dive *dive, struct divecomputer *dc, struct plot_info *pi, bool fast, bool deco, bool print_mode);
+/* the dive computers of a dive shown on top of each other */
+#define MAX_COMPARED_DCS 4
+bool create_plot_info_cached(struct dive *dive, struct divecomputer *dc, struct plot_info *pi);
+void hold_plot_info(struct plot_info *pi);
+void release_plot_info(struct plot_info *pi);
+void calculate_plot_info_deco(struct dive *dive, struct divecomputer *dc, struct plot_info *pi);
+void invalidate_plot_info_cache(void);
 void calculate_deco_information(struct dive *dive, struct divecomputer *dc, struct plot_info *pi, bool print_mode);
+int get_gf_overlays(short gf[MAX_GF_OVERLAYS][2]);
 struct plot_data *get_plot_details_new(struct plot_info *pi, int time, struct membuffer *);
+struct plot_data *get_plot_entry_at(struct plot_info *pi, int time);
+void get_plot_details_string(struct plot_info *pi, struct plot_data *entry, struct membuffer *mb);
 
 /*
  * When showing dive profiles, we scale things to the
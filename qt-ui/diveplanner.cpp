@@ -393,6 +393,7 @@ PlannerSettingsWidget::PlannerSettingsWidget(QWidget *parent, Qt::WindowFlags f)
 	prefs.display_duration = s.value("display_duration", prefs.display_duration).toBool();
 	prefs.display_runtime = s.value("display_runtime", prefs.display_runtime).toBool();
 	prefs.display_transitions = s.value("display_transitions", prefs.display_transitions).toBool();
+	prefs.display_variations = s.value("display_variations", prefs.display_variations).toBool();
 	prefs.recreational_mode = s.value("recreational_mode", prefs.recreational_mode).toBool();
 	prefs.safetystop = s.value("safetystop", prefs.safetystop).toBool();
 	prefs.ascrate75 = s.value("ascrate75", prefs.ascrate75).toInt();
@@ -416,6 +417,7 @@ PlannerSettingsWidget::PlannerSettingsWidget(QWidget *parent, Qt::WindowFlags f)
 	ui.display_duration->setChecked(prefs.display_duration);
 	ui.display_runtime->setChecked(prefs.display_runtime);
 	ui.display_transitions->setChecked(prefs.display_transitions);
+	ui.display_variations->setChecked(prefs.display_variations);
 	ui.recreational_mode->setChecked(prefs.recreational_mode);
 	ui.safetystop->setChecked(prefs.safetystop);
 	ui.bottompo2->setValue(prefs.bottompo2 / 1000.0);
@@ -431,6 +433,7 @@ PlannerSettingsWidget::PlannerSettingsWidget(QWidget *parent, Qt::WindowFlags f)
 	connect(ui.display_duration, SIGNAL(toggled(bool)), plannerModel, SLOT(setDisplayDuration(bool)));
 	connect(ui.display_runtime, SIGNAL(toggled(bool)), plannerModel, SLOT(setDisplayRuntime(bool)));
 	connect(ui.display_transitions, SIGNAL(toggled(bool)), plannerModel, SLOT(setDisplayTransitions(bool)));
+	connect(ui.display_variations, SIGNAL(toggled(bool)), plannerModel, SLOT(setDisplayVariations(bool)));
 	connect(ui.safetystop, SIGNAL(toggled(bool)), plannerModel, SLOT(setSafetyStop(bool)));
 	connect(ui.recreational_mode, SIGNAL(toggled(bool)), plannerModel, SLOT(setRecreationalMode(bool)));
 	connect(ui.ascRate75, SIGNAL(valueChanged(int)), this, SLOT(setAscRate75(int)));
@@ -480,6 +483,7 @@ PlannerSettingsWidget::~PlannerSettingsWidget()
 	s.setValue("display_duration", prefs.display_duration);
 	s.setValue("display_runtime", prefs.display_runtime);
 	s.setValue("display_transitions", prefs.display_transitions);
+	s.setValue("display_variations", prefs.display_variations);
 	s.setValue("recreational_mode", prefs.recreational_mode);
 	s.setValue("safetystop", prefs.safetystop);
 	s.setValue("ascrate75", prefs.ascrate75);
@@ -595,6 +599,10 @@ void PlannerSettingsWidget::setBackgasBreaks(bool dobreaks)
 void DivePlannerPointsModel::setPlanMode(Mode m)
 {
 	mode = m;
+	// the cached tissue state includes the effect of the dives before this one,
+	// which may have changed since we last planned
+	free(cache);
+	cache = NULL;
 	// the planner may reset our GF settings that are used to show deco
 	// reset them to what's in the preferences
 	if (m != PLAN)
@@ -744,6 +752,7 @@ int DivePlannerPointsModel::rowCount(const QModelIndex &parent) const
 }
 
 DivePlannerPointsModel::DivePlannerPointsModel(QObject *parent) : QAbstractTableModel(parent),
+	cache(NULL),
 	mode(NOTHING),
 	recalc(false),
 	tempGFHigh(100),
@@ -869,6 +878,12 @@ void DivePlannerPointsModel::setDisplayTransitions(bool value)
 	emit dataChanged(createIndex(0, 0), createIndex(rowCount() - 1, COLUMNS - 1));
 }
 
+void DivePlannerPointsModel::setDisplayVariations(bool value)
+{
+	prefs.display_variations = value;
+	emit dataChanged(createIndex(0, 0), createIndex(rowCount() - 1, COLUMNS - 1));
+}
+
 void DivePlannerPointsModel::setRecreationalMode(bool value)
 {
 	prefs.recreational_mode = value;
@@ -1215,8 +1230,6 @@ void DivePlannerPointsModel::createTemporaryPlan()
 			plan_add_segment(&diveplan, deltaT, p.depth, p.gasmix, p.setpoint, true);
 	}
 
-	// what does the cache do???
-	char *cache = NULL;
 	struct divedatapoint *dp = NULL;
 	for (int i = 0; i < MAX_CYLINDERS; i++) {
 		cylinder_t *cyl = &displayed_dive.cylinder[i];
@@ -1235,11 +1248,21 @@ void DivePlannerPointsModel::createTemporaryPlan()
 	dump_plan(&diveplan);
 #endif
 	if (plannerModel->recalcQ() && !diveplan_empty(&diveplan)) {
+		struct plan_variation variations[MAX_PLAN_VARIATIONS];
+		struct plan_variation_result results[MAX_PLAN_VARIATIONS];
+		int nr = 0;
+
+		// planning the variations overwrites displayed_dive, so they go first
+		if (isPlanner() && prefs.display_variations) {
+			nr = get_default_plan_variations(&diveplan, variations);
+			plan_variations(&diveplan, &cache, variations, results, nr);
+		}
+		// the cache lets us skip re-simulating the entered waypoints if only
+		// settings that affect the ascent have changed
 		plan(&diveplan, &cache, isPlanner(), false);
+		add_plan_variations_to_notes(&diveplan, &displayed_dive, variations, results, nr);
 		MainWindow::instance()->setPlanNotes(displayed_dive.notes);
 	}
-	// throw away the cache
-	free(cache);
 #if DEBUG_PLAN
 	save_dive(stderr, &displayed_dive);
 	dump_plan(&diveplan);
@@ -1264,7 +1287,6 @@ void DivePlannerPointsModel::saveDuplicatePlan()
 void DivePlannerPointsModel::createPlan(bool replanCopy)
 {
 	// Ok, so, here the diveplan creates a dive
-	char *cache = NULL;
 	bool oldRecalc = plannerModel->setRecalc(false);
 	removeDeco();
 	createTemporaryPlan();
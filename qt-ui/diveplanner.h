@@ -82,6 +82,7 @@ slots:
 	void setDisplayRuntime(bool value);
 	void setDisplayDuration(bool value);
 	void setDisplayTransitions(bool value);
+	void setDisplayVariations(bool value);
 	void setRecreationalMode(bool value);
 	void setSafetyStop(bool value);
 	void savePlan();
@@ -105,6 +106,7 @@ private:
 	bool addGas(struct gasmix mix);
 	void createPlan(bool replanCopy);
 	struct diveplan diveplan;
+	char *cache; // tissue state at the end of the entered waypoints, see tissue_at_end()
 	Mode mode;
 	bool recalc;
 	QVector<divedatapoint> divepoints;
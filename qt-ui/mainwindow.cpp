@@ -386,6 +386,7 @@ void MainWindow::closeCurrentFile()
 		delete_single_dive(0);
 	while (dive_site_table.nr)
 		delete_dive_site(get_dive_site(0)->uuid);
+	clear_deco_chain_cache();
 
 	free((void *)existing_filename);
 	existing_filename = NULL;
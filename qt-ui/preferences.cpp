@@ -132,6 +132,7 @@ void PreferencesDialog::setUiFromPrefs()
 
 	ui.gflow->setValue(prefs.gflow);
 	ui.gfhigh->setValue(prefs.gfhigh);
+	ui.gf_overlay->setText(prefs.gf_overlay);
 	ui.gf_low_at_maxdepth->setChecked(prefs.gf_low_at_maxdepth);
 	ui.show_ccr_setpoint->setChecked(prefs.show_ccr_setpoint);
 	ui.show_ccr_sensors->setChecked(prefs.show_ccr_sensors);
@@ -288,6 +289,7 @@ void PreferencesDialog::syncSettings()
 	SAVE_OR_REMOVE("redceiling", default_prefs.redceiling, ui.red_ceiling->isChecked());
 	SAVE_OR_REMOVE("gflow", default_prefs.gflow, ui.gflow->value());
 	SAVE_OR_REMOVE("gfhigh", default_prefs.gfhigh, ui.gfhigh->value());
+	SAVE_OR_REMOVE("gf_overlay", QString(default_prefs.gf_overlay), ui.gf_overlay->text().simplified());
 	SAVE_OR_REMOVE("gf_low_at_maxdepth", default_prefs.gf_low_at_maxdepth, ui.gf_low_at_maxdepth->isChecked());
 	SAVE_OR_REMOVE("show_ccr_setpoint", default_prefs.show_ccr_setpoint, ui.show_ccr_setpoint->isChecked());
 	SAVE_OR_REMOVE("show_ccr_sensors", default_prefs.show_ccr_sensors, ui.show_ccr_sensors->isChecked());
@@ -406,6 +408,7 @@ void PreferencesDialog::loadSettings()
 	GET_BOOL("percentagegraph", percentagegraph);
 	GET_INT("gflow", gflow);
 	GET_INT("gfhigh", gfhigh);
+	GET_TXT("gf_overlay", gf_overlay);
 	GET_BOOL("gf_low_at_maxdepth", gf_low_at_maxdepth);
 	GET_BOOL("show_ccr_setpoint",show_ccr_setpoint);
 	GET_BOOL("show_ccr_sensors",show_ccr_sensors);
@@ -7,6 +7,8 @@
 #include "gettextfromc.h"
 #include "metrics.h"
 
+#include <QHash>
+
 extern struct ev_select *ev_namelist;
 extern int evn_used;
 
@@ -46,22 +48,40 @@ struct event *DiveEventItem::getEvent()
 
 void DiveEventItem::setEvent(struct event *ev)
 {
-	if (!ev)
-		return;
 	internalEvent = ev;
+	// without an event the item is parked in the profile's pool for the next dive
+	if (!ev) {
+		setToolTip(QString());
+		hide();
+		return;
+	}
 	setupPixmap();
 	setupToolTipString();
 	recalculatePos(true);
 }
 
+// loading and smoothly scaling the icon is the expensive part of setting up an event,
+// and there are only a handful of different ones
+static QPixmap eventPixmap(const QString &name, int size)
+{
+	static QHash<QString, QPixmap> cache;
+	QString key = QString("%1@%2").arg(name).arg(size);
+	QHash<QString, QPixmap>::const_iterator it = cache.constFind(key);
+	if (it != cache.constEnd())
+		return *it;
+	QPixmap pixmap = QPixmap(name).scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+	cache.insert(key, pixmap);
+	return pixmap;
+}
+
 void DiveEventItem::setupPixmap()
 {
 	const IconMetrics& metrics = defaultIconMetrics();
 	int sz_bigger = metrics.sz_med + metrics.sz_small; // ex 40px
 	int sz_pix = sz_bigger/2; // ex 20px
 
-#define EVENT_PIXMAP(PIX) QPixmap(QString(PIX)).scaled(sz_pix, sz_pix, Qt::KeepAspectRatio, Qt::SmoothTransformation)
-#define EVENT_PIXMAP_BIGGER(PIX) QPixmap(QString(PIX)).scaled(sz_bigger, sz_bigger, Qt::KeepAspectRatio, Qt::SmoothTransformation)
+#define EVENT_PIXMAP(PIX) eventPixmap(PIX, sz_pix)
+#define EVENT_PIXMAP_BIGGER(PIX) eventPixmap(PIX, sz_bigger)
 	if (!internalEvent->name) {
 		setPixmap(EVENT_PIXMAP(":warning"));
 	} else if (internalEvent->type == SAMPLE_EVENT_BOOKMARK) {
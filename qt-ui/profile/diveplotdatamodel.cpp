@@ -70,11 +70,15 @@ QVariant DivePlotDataModel::data(const QModelIndex &index, int role) const
 	}
 
 	if (role == Qt::DisplayRole && index.column() >= TISSUE_1 && index.column() <= TISSUE_16) {
-		return item.ceilings[index.column() - TISSUE_1];
+		return item.tissue ? item.tissue->ceilings[index.column() - TISSUE_1] : 0;
 	}
 
 	if (role == Qt::DisplayRole && index.column() >= PERCENTAGE_1 && index.column() <= PERCENTAGE_16) {
-		return item.percentages[index.column() - PERCENTAGE_1];
+		return item.tissue ? item.tissue->percentages[index.column() - PERCENTAGE_1] : 0;
+	}
+
+	if (role == Qt::DisplayRole && index.column() >= GF_CEILING_1 && index.column() <= GF_CEILING_4) {
+		return item.gf_ceilings[index.column() - GF_CEILING_1];
 	}
 
 	if (role == Qt::BackgroundRole) {
@@ -156,11 +160,17 @@ QVariant DivePlotDataModel::headerData(int section, Qt::Orientation orientation,
 	if (role == Qt::DisplayRole && section >= PERCENTAGE_1 && section <= PERCENTAGE_16) {
 		return QString("Tissue: %1").arg(section - PERCENTAGE_1);
 	}
+	if (role == Qt::DisplayRole && section >= GF_CEILING_1 && section <= GF_CEILING_4) {
+		return QString("GF ceiling: %1").arg(section - GF_CEILING_1);
+	}
 	return QVariant();
 }
 
 void DivePlotDataModel::clear()
 {
+	// the plot info cache may reuse the data once no model shows it anymore
+	release_plot_info(&pInfo);
+	pInfo.entry = NULL;
 	if (rowCount() != 0) {
 		beginRemoveRows(QModelIndex(), 0, rowCount() - 1);
 		pInfo.nr = 0;
@@ -177,6 +187,7 @@ void DivePlotDataModel::setDive(dive *d, const plot_info &info)
 	diveId = d->id;
 	dcNr = dc_number;
 	pInfo = info;
+	hold_plot_info(&pInfo);
 	beginInsertRows(QModelIndex(), 0, pInfo.nr - 1);
 	endInsertRows();
 }
@@ -223,7 +234,6 @@ void DivePlotDataModel::emitDataChanged()
 void DivePlotDataModel::calculateDecompression()
 {
 	struct divecomputer *dc = select_dc(&displayed_dive);
-	init_decompression(&displayed_dive);
-	calculate_deco_information(&displayed_dive, dc, &pInfo, false);
-	dataChanged(index(0, CEILING), index(pInfo.nr - 1, TISSUE_16));
+	calculate_plot_info_deco(&displayed_dive, dc, &pInfo);
+	dataChanged(index(0, CEILING), index(pInfo.nr - 1, GF_CEILING_4));
 }
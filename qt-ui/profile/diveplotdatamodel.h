@@ -67,6 +67,10 @@ public:
 		AMBPRESSURE,
 		GFLINE,
 		INSTANT_MEANDEPTH,
+		GF_CEILING_1,
+		GF_CEILING_2,
+		GF_CEILING_3,
+		GF_CEILING_4,
 		COLUMNS
 	};
 	explicit DivePlotDataModel(QObject *parent = 0);
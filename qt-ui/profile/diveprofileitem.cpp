@@ -15,7 +15,7 @@
 
 #include <QSettings>
 
-AbstractProfilePolygonItem::AbstractProfilePolygonItem() : QObject(), QGraphicsPolygonItem(), hAxis(NULL), vAxis(NULL), dataModel(NULL), hDataColumn(-1), vDataColumn(-1)
+AbstractProfilePolygonItem::AbstractProfilePolygonItem() : QObject(), QGraphicsPolygonItem(), hAxis(NULL), vAxis(NULL), dataModel(NULL), hDataColumn(-1), vDataColumn(-1), lodColumnWidth(0)
 {
 	setCacheMode(DeviceCoordinateCache);
 	connect(PreferencesDialog::instance(), SIGNAL(settingsChanged()), this, SLOT(settingsChanged()));
@@ -106,6 +106,113 @@ void AbstractProfilePolygonItem::modelDataChanged(const QModelIndex &topLeft, co
 	texts.clear();
 }
 
+// the width of one device pixel column in item coordinates; zero if we can't tell
+qreal AbstractProfilePolygonItem::columnWidth(QPainter *painter)
+{
+	qreal scale = qAbs(painter->worldTransform().m11());
+	return scale > 0 ? 1.0 / scale : 0;
+}
+
+static void appendSorted(QVector<int> &indexes, int a, int b, int c, int d)
+{
+	int bucket[4] = { a, b, c, d };
+
+	for (int i = 1; i < 4; i++) {
+		int j, val = bucket[i];
+		for (j = i; j > 0 && bucket[j - 1] > val; j--)
+			bucket[j] = bucket[j - 1];
+		bucket[j] = val;
+	}
+	for (int i = 0; i < 4; i++) {
+		if (i && bucket[i] == bucket[i - 1])
+			continue;
+		indexes.append(bucket[i]);
+	}
+}
+
+/* Walk the polyline and collect runs of consecutive points that fall into the
+ * same pixel column. Of every run only the first and the last point (so the
+ * lines to the neighbouring columns stay where they were) and the lowest and
+ * the highest point (so no spike disappears) are kept, in their original order.
+ * The points don't need to be sorted by x - the closing edge of a filled polygon
+ * simply starts new runs on its way back. */
+QVector<int> AbstractProfilePolygonItem::decimatedIndexes(const QPolygonF &poly, qreal width)
+{
+	QVector<int> indexes;
+	int count = poly.count();
+
+	if (width <= 0 || count <= 4) {
+		for (int i = 0; i < count; i++)
+			indexes.append(i);
+		return indexes;
+	}
+	int first = 0, min = 0, max = 0;
+	qreal column = floor(poly[0].x() / width);
+	for (int i = 1; i <= count; i++) {
+		qreal thisColumn = 0;
+		if (i < count) {
+			thisColumn = floor(poly[i].x() / width);
+			if (thisColumn == column) {
+				if (poly[i].y() < poly[min].y())
+					min = i;
+				if (poly[i].y() > poly[max].y())
+					max = i;
+				continue;
+			}
+		}
+		appendSorted(indexes, first, min, max, i - 1);
+		first = min = max = i;
+		column = thisColumn;
+	}
+	return indexes;
+}
+
+QPolygonF AbstractProfilePolygonItem::decimatedPolygon(const QPolygonF &poly, qreal width)
+{
+	QVector<int> indexes = decimatedIndexes(poly, width);
+	if (indexes.count() == poly.count())
+		return poly;
+	QPolygonF result;
+	result.reserve(indexes.count());
+	Q_FOREACH (int i, indexes)
+		result.append(poly[i]);
+	return result;
+}
+
+// only redo the decimation if either the polygon or the zoom changed since the last paint
+const QPolygonF &AbstractProfilePolygonItem::lodPolygon(QPainter *painter)
+{
+	const QPolygonF poly = polygon();
+	qreal width = columnWidth(painter);
+	if (poly.constData() != lodSource.constData() || poly.count() != lodSource.count() || width != lodColumnWidth) {
+		lodSource = poly;
+		lodColumnWidth = width;
+		lodPoly = decimatedPolygon(poly, width);
+	}
+	return lodPoly;
+}
+
+void AbstractProfilePolygonItem::paintPolyline(QPainter *painter)
+{
+	if (polygon().isEmpty())
+		return;
+	painter->save();
+	painter->setPen(pen());
+	painter->drawPolyline(lodPolygon(painter));
+	painter->restore();
+}
+
+void AbstractProfilePolygonItem::paintFilledPolygon(QPainter *painter)
+{
+	if (polygon().isEmpty())
+		return;
+	painter->save();
+	painter->setPen(pen());
+	painter->setBrush(brush());
+	painter->drawPolygon(lodPolygon(painter), fillRule());
+	painter->restore();
+}
+
 DiveProfileItem::DiveProfileItem() : show_reported_ceiling(0), reported_ceiling_in_red(0)
 {
 }
@@ -120,20 +227,23 @@ void DiveProfileItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *o
 	// This paints the Polygon + Background. I'm setting the pen to QPen() so we don't get a black line here,
 	// after all we need to plot the correct velocities colors later.
 	setPen(Qt::NoPen);
-	QGraphicsPolygonItem::paint(painter, option, widget);
+	paintFilledPolygon(painter);
 
 	// Here we actually paint the boundaries of the Polygon using the colors that the model provides.
-	// Those are the speed colors of the dives.
+	// Those are the speed colors of the dives. The first rowCount() points of the polygon are the
+	// samples, so the decimated indexes are also the model rows - a segment that spans several
+	// samples gets the color of the last one.
 	QPen pen;
 	pen.setCosmetic(true);
 	pen.setWidth(2);
-	QPolygonF poly = polygon();
+	QPolygonF poly = polygon().mid(0, dataModel->rowCount());
+	QVector<int> rows = decimatedIndexes(poly, columnWidth(painter));
 	// This paints the colors of the velocities.
-	for (int i = 1, count = dataModel->rowCount(); i < count; i++) {
-		QModelIndex colorIndex = dataModel->index(i, DivePlotDataModel::COLOR);
+	for (int i = 1, count = rows.count(); i < count; i++) {
+		QModelIndex colorIndex = dataModel->index(rows[i], DivePlotDataModel::COLOR);
 		pen.setBrush(QBrush(colorIndex.data(Qt::BackgroundRole).value<QColor>()));
 		painter->setPen(pen);
-		painter->drawLine(poly[i - 1], poly[i]);
+		painter->drawLine(poly[rows[i - 1]], poly[rows[i]]);
 	}
 	painter->restore();
 }
@@ -142,9 +252,11 @@ int DiveProfileItem::maxCeiling(int row)
 {
 	int max = -1;
 	plot_data *entry = dataModel->data().entry + row;
+	if (!entry->tissue)
+		return max;
 	for (int tissue = 0; tissue < 16; tissue++) {
-		if (max < entry->ceilings[tissue])
-			max = entry->ceilings[tissue];
+		if (max < entry->tissue->ceilings[tissue])
+			max = entry->tissue->ceilings[tissue];
 	}
 	return max;
 }
@@ -321,12 +433,7 @@ void DiveHeartrateItem::createTextItem(int sec, int hr)
 
 void DiveHeartrateItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
-	if (polygon().isEmpty())
-		return;
-	painter->save();
-	painter->setPen(pen());
-	painter->drawPolyline(polygon());
-	painter->restore();
+	paintPolyline(painter);
 }
 
 void DiveHeartrateItem::settingsChanged()
@@ -372,12 +479,7 @@ void DivePercentageItem::modelDataChanged(const QModelIndex &topLeft, const QMod
 
 void DivePercentageItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
-	if (polygon().isEmpty())
-		return;
-	painter->save();
-	painter->setPen(pen());
-	painter->drawPolyline(polygon());
-	painter->restore();
+	paintPolyline(painter);
 }
 
 void DivePercentageItem::settingsChanged()
@@ -421,12 +523,7 @@ void DiveAmbPressureItem::modelDataChanged(const QModelIndex &topLeft, const QMo
 
 void DiveAmbPressureItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
-	if (polygon().isEmpty())
-		return;
-	painter->save();
-	painter->setPen(pen());
-	painter->drawPolyline(polygon());
-	painter->restore();
+	paintPolyline(painter);
 }
 
 void DiveAmbPressureItem::settingsChanged()
@@ -470,12 +567,7 @@ void DiveGFLineItem::modelDataChanged(const QModelIndex &topLeft, const QModelIn
 
 void DiveGFLineItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
-	if (polygon().isEmpty())
-		return;
-	painter->save();
-	painter->setPen(pen());
-	painter->drawPolyline(polygon());
-	painter->restore();
+	paintPolyline(painter);
 }
 
 void DiveGFLineItem::settingsChanged()
@@ -555,12 +647,7 @@ void DiveTemperatureItem::createTextItem(int sec, int mkelvin)
 
 void DiveTemperatureItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
-	if (polygon().isEmpty())
-		return;
-	painter->save();
-	painter->setPen(pen());
-	painter->drawPolyline(polygon());
-	painter->restore();
+	paintPolyline(painter);
 }
 
 DiveMeanDepthItem::DiveMeanDepthItem()
@@ -599,12 +686,7 @@ void DiveMeanDepthItem::modelDataChanged(const QModelIndex &topLeft, const QMode
 
 void DiveMeanDepthItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
-	if (polygon().isEmpty())
-		return;
-	painter->save();
-	painter->setPen(pen());
-	painter->drawPolyline(polygon());
-	painter->restore();
+	paintPolyline(painter);
 }
 
 void DiveMeanDepthItem::settingsChanged()
@@ -776,12 +858,14 @@ void DiveGasPressureItem::paint(QPainter *painter, const QStyleOptionGraphicsIte
 	pen.setWidth(2);
 	painter->save();
 	struct plot_data *entry;
+	qreal width = columnWidth(painter);
 	Q_FOREACH (const QPolygonF &poly, polygons) {
-		entry = dataModel->data().entry;
-		for (int i = 1, count = poly.count(); i < count; i++, entry++) {
+		QVector<int> indexes = decimatedIndexes(poly, width);
+		for (int i = 1, count = indexes.count(); i < count; i++) {
+			entry = dataModel->data().entry + indexes[i] - 1;
 			pen.setBrush(getSacColor(entry->sac, displayed_dive.sac));
 			painter->setPen(pen);
-			painter->drawLine(poly[i - 1], poly[i]);
+			painter->drawLine(poly[indexes[i - 1]], poly[indexes[i]]);
 		}
 	}
 	painter->restore();
@@ -833,9 +917,7 @@ void DiveCalculatedCeiling::modelDataChanged(const QModelIndex &topLeft, const Q
 
 void DiveCalculatedCeiling::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
-	if (polygon().isEmpty())
-		return;
-	QGraphicsPolygonItem::paint(painter, option, widget);
+	paintFilledPolygon(painter);
 }
 
 DiveCalculatedTissue::DiveCalculatedTissue()
@@ -848,6 +930,130 @@ void DiveCalculatedTissue::settingsChanged()
 	setVisible(prefs.calcalltissues && prefs.calcceiling);
 }
 
+DiveGFCeilingItem::DiveGFCeilingItem(int i) : overlay(i)
+{
+	QPen pen;
+	QColor color = getColor(CALC_CEILING_DEEP);
+	pen.setBrush(QBrush(color.darker(120 + 30 * i)));
+	pen.setCosmetic(true);
+	pen.setWidth(1);
+	pen.setStyle(Qt::DashLine);
+	setPen(pen);
+	settingsChanged();
+}
+
+void DiveGFCeilingItem::modelDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+	short gf[MAX_GF_OVERLAYS][2];
+
+	// the label of the last run is at the old position, even if we don't get to add a new one
+	qDeleteAll(texts);
+	texts.clear();
+
+	// We don't have enougth data to calculate things, quit.
+	if (!shouldCalculateStuff(topLeft, bottomRight))
+		return;
+	AbstractProfilePolygonItem::modelDataChanged(topLeft, bottomRight);
+	if (overlay >= get_gf_overlays(gf))
+		return;
+
+	// name the curve at its deepest point - if there is a ceiling at all
+	plot_data *entry = dataModel->data().entry;
+	int deepest = 0;
+	for (int i = 1, count = dataModel->rowCount(); i < count; i++) {
+		if (entry[i].gf_ceilings[overlay] > entry[deepest].gf_ceilings[overlay])
+			deepest = i;
+	}
+	if (!entry[deepest].gf_ceilings[overlay])
+		return;
+	DiveTextItem *text = new DiveTextItem(this);
+	text->setAlignment(Qt::AlignHCenter | Qt::AlignBottom);
+	text->setBrush(pen().brush());
+	text->setPos(hAxis->posAtValue(entry[deepest].sec), vAxis->posAtValue(entry[deepest].gf_ceilings[overlay]));
+	text->setScale(0.7); // need to call this BEFORE setText()
+	text->setText(QString("GF %1/%2").arg(gf[overlay][0]).arg(gf[overlay][1]));
+	texts.append(text);
+}
+
+void DiveGFCeilingItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+	paintPolyline(painter);
+}
+
+void DiveGFCeilingItem::settingsChanged()
+{
+	short gf[MAX_GF_OVERLAYS][2];
+	setVisible(prefs.calcceiling && overlay < get_gf_overlays(gf));
+}
+
+DiveComputerCompareItem::DiveComputerCompareItem(int i, int column)
+{
+	static const Qt::PenStyle styles[] = { Qt::DashLine, Qt::DotLine, Qt::DashDotLine };
+	QPen pen;
+	switch (column) {
+	case DivePlotDataModel::TEMPERATURE:
+		pen.setBrush(QBrush(getColor(TEMP_PLOT)));
+		break;
+	case DivePlotDataModel::PRESSURE:
+		pen.setBrush(QBrush(getColor(PRESSURE_TEXT)));
+		break;
+	default:
+		pen.setBrush(QBrush(getColor(DEPTH_BOTTOM)));
+		break;
+	}
+	pen.setCosmetic(true);
+	pen.setWidth(1);
+	pen.setStyle(styles[i % 3]);
+	setPen(pen);
+}
+
+void DiveComputerCompareItem::setName(const QString &name)
+{
+	dcName = name;
+}
+
+void DiveComputerCompareItem::modelDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+	// We don't have enougth data to calculate things, quit.
+	if (!shouldCalculateStuff(topLeft, bottomRight))
+		return;
+
+	qDeleteAll(texts);
+	texts.clear();
+	// a temperature or pressure of zero means the dive computer didn't record one
+	bool isDepth = vDataColumn == DivePlotDataModel::DEPTH;
+	int deepest = 0, maxdepth = 0;
+	QPolygonF poly;
+	for (int i = 0, modelDataCount = dataModel->rowCount(); i < modelDataCount; i++) {
+		int value = dataModel->index(i, vDataColumn).data().toInt();
+		if (!value && !isDepth)
+			continue;
+		int sec = dataModel->index(i, hDataColumn).data().toInt();
+		poly.append(QPointF(hAxis->posAtValue(sec), vAxis->posAtValue(value)));
+		if (value > maxdepth) {
+			maxdepth = value;
+			deepest = sec;
+		}
+	}
+	setPolygon(poly);
+
+	// name the depth curve at its deepest point
+	if (!isDepth || !maxdepth || dcName.isEmpty())
+		return;
+	DiveTextItem *text = new DiveTextItem(this);
+	text->setAlignment(Qt::AlignHCenter | Qt::AlignBottom);
+	text->setBrush(pen().brush());
+	text->setPos(hAxis->posAtValue(deepest), vAxis->posAtValue(maxdepth));
+	text->setScale(0.7); // need to call this BEFORE setText()
+	text->setText(dcName);
+	texts.append(text);
+}
+
+void DiveComputerCompareItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+	paintPolyline(painter);
+}
+
 void DiveReportedCeiling::modelDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
 {
 	if (!shouldCalculateStuff(topLeft, bottomRight))
@@ -899,9 +1105,7 @@ void DiveReportedCeiling::settingsChanged()
 
 void DiveReportedCeiling::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
-	if (polygon().isEmpty())
-		return;
-	QGraphicsPolygonItem::paint(painter, option, widget);
+	paintFilledPolygon(painter);
 }
 
 void PartialPressureGasItem::modelDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
@@ -947,12 +1151,12 @@ void PartialPressureGasItem::paint(QPainter *painter, const QStyleOptionGraphics
 	const qreal pWidth = 0.0;
 	painter->save();
 	painter->setPen(QPen(normalColor, pWidth));
-	painter->drawPolyline(polygon());
+	painter->drawPolyline(lodPolygon(painter));
 
-	QPolygonF poly;
+	qreal width = columnWidth(painter);
 	painter->setPen(QPen(alertColor, pWidth));
 	Q_FOREACH (const QPolygonF &poly, alertPolygons)
-		painter->drawPolyline(poly);
+		painter->drawPolyline(decimatedPolygon(poly, width));
 	painter->restore();
 }
 
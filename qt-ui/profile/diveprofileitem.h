@@ -60,12 +60,29 @@ protected:
 	 */
 	bool shouldCalculateStuff(const QModelIndex &topLeft, const QModelIndex &bottomRight);
 
+	/* level of detail: a dive with 1s samples has far more points than the view has pixel
+	 * columns, so the paint methods only draw the points that can actually be told apart
+	 * at the painter's current zoom. decimatedIndexes() keeps the first, last, lowest and
+	 * highest point of every pixel column; lodPolygon() caches that for polygon().
+	 */
+	static qreal columnWidth(QPainter *painter);
+	static QVector<int> decimatedIndexes(const QPolygonF &poly, qreal width);
+	static QPolygonF decimatedPolygon(const QPolygonF &poly, qreal width);
+	const QPolygonF &lodPolygon(QPainter *painter);
+	void paintPolyline(QPainter *painter);
+	void paintFilledPolygon(QPainter *painter);
+
 	DiveCartesianAxis *hAxis;
 	DiveCartesianAxis *vAxis;
 	DivePlotDataModel *dataModel;
 	int hDataColumn;
 	int vDataColumn;
 	QList<DiveTextItem *> texts;
+
+private:
+	QPolygonF lodSource;
+	QPolygonF lodPoly;
+	qreal lodColumnWidth;
 };
 
 class DiveProfileItem : public AbstractProfilePolygonItem {
@@ -206,6 +223,33 @@ public:
 	virtual void settingsChanged();
 };
 
+/* the calculated ceiling for one of the extra gradient factor pairs in prefs.gf_overlay */
+class DiveGFCeilingItem : public AbstractProfilePolygonItem {
+	Q_OBJECT
+public:
+	DiveGFCeilingItem(int i);
+	virtual void modelDataChanged(const QModelIndex &topLeft = QModelIndex(), const QModelIndex &bottomRight = QModelIndex());
+	virtual void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = 0);
+	virtual void settingsChanged();
+
+private:
+	int overlay;
+};
+
+/* the depth, temperature or pressure curve of another dive computer of the dive, to compare it
+ * with the one shown; the same column of the different computers only differs in the line style */
+class DiveComputerCompareItem : public AbstractProfilePolygonItem {
+	Q_OBJECT
+public:
+	DiveComputerCompareItem(int i, int column);
+	virtual void modelDataChanged(const QModelIndex &topLeft = QModelIndex(), const QModelIndex &bottomRight = QModelIndex());
+	virtual void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = 0);
+	void setName(const QString &name);
+
+private:
+	QString dcName;
+};
+
 class PartialPressureGasItem : public AbstractProfilePolygonItem {
 	Q_OBJECT
 public:
@@ -2,6 +2,21 @@
 #include "mainwindow.h"
 #include "profilewidget2.h"
 
+#include <QHash>
+
+/* The same labels (axis ticks, gas names, depths) show up over and over again
+ * when switching between dives, so the laid out text and its outline are kept
+ * by font, alignment and string instead of running QPainterPath::addText() and
+ * the stroker for every new item. */
+struct DiveTextPaths {
+	QPainterPath text;
+	QPainterPath background;
+};
+
+static QHash<QString, DiveTextPaths> textPathCache;
+
+#define MAX_CACHED_TEXT_PATHS 1000
+
 DiveTextItem::DiveTextItem(QGraphicsItem *parent) : QGraphicsItemGroup(parent),
 	internalAlignFlags(Qt::AlignHCenter | Qt::AlignVCenter),
 	textBackgroundItem(new QGraphicsPathItem(this)),
@@ -65,6 +80,13 @@ void DiveTextItem::updateText()
 		size *= scale * MainWindow::instance()->graphics()->getFontPrintScale();
 		fnt.setPointSizeF(size);
 	}
+	QString key = QString("%1|%2|%3").arg(fnt.key()).arg(internalAlignFlags).arg(internalText);
+	QHash<QString, DiveTextPaths>::const_iterator cached = textPathCache.constFind(key);
+	if (cached != textPathCache.constEnd()) {
+		textBackgroundItem->setPath(cached->background);
+		textItem->setPath(cached->text);
+		return;
+	}
 	QFontMetrics fm(fnt);
 
 	QPainterPath textPath;
@@ -82,6 +104,12 @@ void DiveTextItem::updateText()
 	textPath.addText(xPos, yPos, fnt, internalText);
 	QPainterPathStroker stroker;
 	stroker.setWidth(3);
-	textBackgroundItem->setPath(stroker.createStroke(textPath));
-	textItem->setPath(textPath);
+	DiveTextPaths paths;
+	paths.text = textPath;
+	paths.background = stroker.createStroke(textPath);
+	if (textPathCache.count() >= MAX_CACHED_TEXT_PATHS)
+		textPathCache.clear();
+	textPathCache.insert(key, paths);
+	textBackgroundItem->setPath(paths.background);
+	textItem->setPath(paths.text);
 }
@@ -4,6 +4,7 @@
 #include "profile.h"
 #include "membuffer.h"
 #include "metrics.h"
+#include "preferences.h"
 #include <QPropertyAnimation>
 #include <QSettings>
 #include <QGraphicsView>
@@ -153,12 +154,14 @@ ToolTipItem::ToolTipItem(QGraphicsItem *parent) : QGraphicsRectItem(parent),
 	title->setBrush(Qt::white);
 
 	setPen(QPen(Qt::white, 2));
+	connect(PreferencesDialog::instance(), SIGNAL(settingsChanged()), this, SLOT(settingsChanged()));
 	refreshTime.start();
 }
 
 ToolTipItem::~ToolTipItem()
 {
 	clear();
+	release_plot_info(&pInfo);
 }
 
 void ToolTipItem::updateTitlePosition()
@@ -220,7 +223,21 @@ void ToolTipItem::readPos()
 
 void ToolTipItem::setPlotInfo(const plot_info &plot)
 {
+	// the plot info cache mustn't reuse the entries while we show their details
+	plot_info info = plot;
+	hold_plot_info(&info);
+	release_plot_info(&pInfo);
 	pInfo = plot;
+	entryStrings.clear();
+	entryStrings.resize(pInfo.nr);
+	lastTime = -1;
+}
+
+// the units and the values shown depend on the preferences, so format the details again
+void ToolTipItem::settingsChanged()
+{
+	entryStrings.fill(QString());
+	lastTime = -1;
 }
 
 void ToolTipItem::setTimeAxis(DiveCartesianAxis *axis)
@@ -246,9 +263,14 @@ void ToolTipItem::refresh(const QPointF &pos)
 	lastTime = time;
 	clear();
 
-	mb.len = 0;
-	entry = get_plot_details_new(&pInfo, time, &mb);
+	entry = get_plot_entry_at(&pInfo, time);
 	if (entry) {
+		QString &details = entryStrings[entry - pInfo.entry];
+		if (details.isNull()) {
+			mb.len = 0;
+			get_plot_details_string(&pInfo, entry, &mb);
+			details = QString::fromUtf8(mb.buffer, mb.len);
+		}
 		tissues.fill();
 		painter.setPen(QColor(0, 0, 0, 0));
 		painter.setBrush(QColor(LIMENADE1));
@@ -262,11 +284,11 @@ void ToolTipItem::refresh(const QPointF &pos)
 		painter.drawLine(0, 60 - AMB_PERCENTAGE * (entry->pressures.n2 + entry->pressures.he) / entry->ambpressure / 2,
 				16, 60 - AMB_PERCENTAGE * (entry->pressures.n2 + entry->pressures.he) / entry->ambpressure /2);
 		painter.setPen(QColor(0, 0, 0, 127));
-		for (int i=0; i<16; i++) {
-			painter.drawLine(i, 60, i, 60 - entry->percentages[i] / 2);
+		for (int i=0; entry->tissue && i<16; i++) {
+			painter.drawLine(i, 60, i, 60 - entry->tissue->percentages[i] / 2);
 		}
 		entryToolTip.first->setPixmap(tissues);
-		entryToolTip.second->setText(QString::fromUtf8(mb.buffer, mb.len));
+		entryToolTip.second->setText(details);
 	}
 
 	Q_FOREACH (QGraphicsItem *item, scene()->items(pos, Qt::IntersectsItemBoundingRect
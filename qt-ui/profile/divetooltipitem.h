@@ -48,6 +48,7 @@ public:
 public
 slots:
 	void setRect(const QRectF &rect);
+	void settingsChanged();
 
 private:
 	typedef QPair<QGraphicsPixmapItem *, QGraphicsSimpleTextItem *> ToolTip;
@@ -59,6 +60,7 @@ private:
 	QRectF nextRectangle;
 	DiveCartesianAxis *timeAxis;
 	plot_info pInfo;
+	QVector<QString> entryStrings; // formatted details, per plot entry, filled on demand
 	int lastTime;
 	QTime refreshTime;
 	QList<QGraphicsItem*> oldSelection;
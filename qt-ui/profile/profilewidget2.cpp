@@ -22,6 +22,7 @@
 #include <QInputDialog>
 #include <QDebug>
 #include <QWheelEvent>
+#include <QTimer>
 
 #ifndef QT_NO_DEBUG
 #include <QTableView>
@@ -29,6 +30,12 @@
 #include "mainwindow.h"
 #include <preferences.h>
 
+/* how often we rerun the planner at most while the plan is being edited (ms) */
+#define REPLAN_INTERVAL 40
+
+/* how long the shown dive has to stay the same before we run the deco calculations (ms) */
+#define DECO_DELAY 100
+
 /* This is the global 'Item position' variable.
  * it should tell you where to position things up
  * on the canvas.
@@ -74,6 +81,8 @@ ProfileWidget2::ProfileWidget2(QWidget *parent) : QGraphicsView(parent),
 	backgroundFile(":poster"),
 	toolTipItem(new ToolTipItem()),
 	isPlotZoomed(prefs.zoomed_plot),
+	replanTimer(new QTimer(this)),
+	decoTimer(new QTimer(this)),
 	profileYAxis(new DepthAxis()),
 	gasYAxis(new PartialGasPressureAxis()),
 	temperatureAxis(new TemperatureAxis()),
@@ -106,7 +115,8 @@ ProfileWidget2::ProfileWidget2(QWidget *parent) : QGraphicsView(parent),
 	printMode(false),
 	shouldCalculateMaxTime(true),
 	shouldCalculateMaxDepth(true),
-	fontPrintScale(1.0)
+	fontPrintScale(1.0),
+	compareDCs(false)
 {
 	memset(&plotInfo, 0, sizeof(plotInfo));
 
@@ -143,6 +153,7 @@ ProfileWidget2::ProfileWidget2(QWidget *parent) : QGraphicsView(parent),
 
 ProfileWidget2::~ProfileWidget2()
 {
+	release_plot_info(&plotInfo);
 	delete background;
 	delete toolTipItem;
 	delete profileYAxis;
@@ -225,6 +236,12 @@ void ProfileWidget2::addItemsToScene()
 	Q_FOREACH (DivePercentageItem *percentage, allPercentages) {
 		scene()->addItem(percentage);
 	}
+	Q_FOREACH (DiveGFCeilingItem *gfCeiling, allGFCeilings) {
+		scene()->addItem(gfCeiling);
+	}
+	Q_FOREACH (DiveComputerCompareItem *compareItem, compareItems) {
+		scene()->addItem(compareItem);
+	}
 	scene()->addItem(ambPressureItem);
 	scene()->addItem(gflineItem);
 }
@@ -291,6 +308,22 @@ void ProfileWidget2::setupItemOnScene()
 		setupItem(percentageItem, timeAxis, percentageAxis, dataModel, DivePlotDataModel::PERCENTAGE_1 + i, DivePlotDataModel::TIME, 1 + i);
 		allPercentages.append(percentageItem);
 	}
+	for (int i = 0; i < MAX_GF_OVERLAYS; i++) {
+		DiveGFCeilingItem *gfCeilingItem = new DiveGFCeilingItem(i);
+		setupItem(gfCeilingItem, timeAxis, profileYAxis, dataModel, DivePlotDataModel::GF_CEILING_1 + i, DivePlotDataModel::TIME, 1);
+		allGFCeilings.append(gfCeilingItem);
+	}
+	for (int i = 0; i < MAX_COMPARED_DCS - 1; i++) {
+		DivePlotDataModel *compareModel = new DivePlotDataModel(this);
+		DiveComputerCompareItem *depthItem = new DiveComputerCompareItem(i, DivePlotDataModel::DEPTH);
+		DiveComputerCompareItem *tempItem = new DiveComputerCompareItem(i, DivePlotDataModel::TEMPERATURE);
+		DiveComputerCompareItem *pressureItem = new DiveComputerCompareItem(i, DivePlotDataModel::PRESSURE);
+		setupItem(depthItem, timeAxis, profileYAxis, compareModel, DivePlotDataModel::DEPTH, DivePlotDataModel::TIME, 1);
+		setupItem(tempItem, timeAxis, temperatureAxis, compareModel, DivePlotDataModel::TEMPERATURE, DivePlotDataModel::TIME, 1);
+		setupItem(pressureItem, timeAxis, cylinderPressureAxis, compareModel, DivePlotDataModel::PRESSURE, DivePlotDataModel::TIME, 1);
+		compareModels.append(compareModel);
+		compareItems << depthItem << tempItem << pressureItem;
+	}
 	setupItem(gasPressureItem, timeAxis, cylinderPressureAxis, dataModel, DivePlotDataModel::TEMPERATURE, DivePlotDataModel::TIME, 1);
 	setupItem(temperatureItem, timeAxis, temperatureAxis, dataModel, DivePlotDataModel::TEMPERATURE, DivePlotDataModel::TIME, 1);
 	setupItem(heartBeatItem, timeAxis, heartBeatAxis, dataModel, DivePlotDataModel::HEARTBEAT, DivePlotDataModel::TIME, 1);
@@ -330,10 +363,38 @@ void ProfileWidget2::setupItemOnScene()
 	percentageAxis->setLinesVisible(true);
 
 	replotEnabled = true;
+
+	// while planning, replots are coalesced - see replot()
+	replanTimer->setSingleShot(true);
+	replanTimer->setInterval(REPLAN_INTERVAL);
+	connect(replanTimer, SIGNAL(timeout()), this, SLOT(replotNow()));
+
+	// when browsing the dive list the deco information is calculated
+	// only once we stay on a dive - see plotDive()
+	decoTimer->setSingleShot(true);
+	decoTimer->setInterval(DECO_DELAY);
+	connect(decoTimer, SIGNAL(timeout()), this, SLOT(plotDeco()));
 }
 
 void ProfileWidget2::replot()
 {
+	if (!replotEnabled)
+		return;
+	// In the planner every waypoint drag, cylinder edit or settings change
+	// asks for a replot, and each replot runs the whole planner. Instead of
+	// planning every intermediate state we plan at most once per interval,
+	// always with the latest waypoints and settings.
+	if (currentState == PLAN || currentState == ADD) {
+		if (!replanTimer->isActive())
+			replanTimer->start();
+		return;
+	}
+	replotNow();
+}
+
+void ProfileWidget2::replotNow()
+{
+	replanTimer->stop();
 	if (!replotEnabled)
 		return;
 	dataModel->clear();
@@ -485,9 +546,13 @@ void ProfileWidget2::plotDive(struct dive *d, bool force)
 		if (d->id == displayed_dive.id && dc_number == dataModel->dcShown() && !force)
 			return;
 
+		// whatever deco calculation was pending, it was for what we showed before
+		decoTimer->stop();
+
 		// this copies the dive and makes copies of all the relevant additional data
 		copy_dive(d, &displayed_dive);
 	} else {
+		decoTimer->stop();
 		DivePlannerPointsModel *plannerModel = DivePlannerPointsModel::instance();
 		plannerModel->createTemporaryPlan();
 		if (!plannerModel->getDiveplan().dp) {
@@ -534,6 +599,23 @@ void ProfileWidget2::plotDive(struct dive *d, bool force)
 	ccrsensor2GasItem->setVisible(sensorflag && (currentdc->no_o2sensors > 1));
 	ccrsensor3GasItem->setVisible(sensorflag && (currentdc->no_o2sensors > 2));
 
+	/* The deco information (ceilings, tissues and NDL / TTS) is by far
+	 * the most expensive part. When showing a logged dive we draw the
+	 * profile without it and only calculate it once the user stays on
+	 * this dive, so that moving through the dive list doesn't calculate
+	 * the deco of every dive passed over. The planner and printing need
+	 * it right away.
+	 * Logged dives also go through the plot info cache, so showing a
+	 * dive again doesn't need to calculate anything.
+	 */
+	bool deferDeco = currentState != ADD && currentState != PLAN && !printMode;
+	bool haveDeco = true;
+
+	// the compared dive computers may still show plot info that's about to be
+	// replaced in the cache, so drop it before the axes make them recalculate
+	Q_FOREACH (DivePlotDataModel *compareModel, compareModels)
+		compareModel->clear();
+
 	/* This struct holds all the data that's about to be plotted.
 	 * I'm not sure this is the best approach ( but since we are
 	 * interpolating some points of the Dive, maybe it is... )
@@ -541,8 +623,13 @@ void ProfileWidget2::plotDive(struct dive *d, bool force)
 	 * so I'll *not* calculate everything if something is not being
 	 * shown.
 	 */
-	plotInfo = calculate_max_limits_new(&displayed_dive, currentdc);
-	create_plot_info_new(&displayed_dive, currentdc, &plotInfo, !shouldCalculateMaxDepth);
+	release_plot_info(&plotInfo);
+	if (deferDeco) {
+		haveDeco = create_plot_info_cached(&displayed_dive, currentdc, &plotInfo);
+	} else {
+		plotInfo = calculate_max_limits_new(&displayed_dive, currentdc);
+		create_plot_info_new(&displayed_dive, currentdc, &plotInfo, !shouldCalculateMaxDepth, true, printMode);
+	}
 	if (shouldCalculateMaxTime)
 		maxtime = get_maxtime(&plotInfo);
 
@@ -605,25 +692,34 @@ void ProfileWidget2::plotDive(struct dive *d, bool force)
 
 	rulerItem->setPlotInfo(plotInfo);
 	tankItem->setData(dataModel, &plotInfo, &displayed_dive);
+	plotComparedDCs(currentdc);
 
 	dataModel->emitDataChanged();
 	// The event items are a bit special since we don't know how many events are going to
 	// exist on a dive, so I cant create cache items for that. that's why they are here
-	// while all other items are up there on the constructor.
-	qDeleteAll(eventItems);
+	// while all other items are up there on the constructor. The ones the last dive had
+	// are kept in a pool and get a new event, only the missing ones are created.
+	spareEventItems += eventItems;
 	eventItems.clear();
 	struct event *event = currentdc->events;
 	while (event) {
-		DiveEventItem *item = new DiveEventItem();
-		item->setHorizontalAxis(timeAxis);
-		item->setVerticalAxis(profileYAxis);
-		item->setModel(dataModel);
+		DiveEventItem *item;
+		if (!spareEventItems.isEmpty()) {
+			item = spareEventItems.takeLast();
+		} else {
+			item = new DiveEventItem();
+			item->setHorizontalAxis(timeAxis);
+			item->setVerticalAxis(profileYAxis);
+			item->setModel(dataModel);
+			item->setZValue(2);
+			scene()->addItem(item);
+		}
 		item->setEvent(event);
-		item->setZValue(2);
-		scene()->addItem(item);
 		eventItems.push_back(item);
 		event = event->next;
 	}
+	Q_FOREACH (DiveEventItem *item, spareEventItems)
+		item->setEvent(NULL);
 	// Only set visible the events that should be visible
 	Q_FOREACH (DiveEventItem *event, eventItems) {
 		event->setVisible(!event->shouldBeHidden());
@@ -646,9 +742,31 @@ void ProfileWidget2::plotDive(struct dive *d, bool force)
 	}
 	plotPictures();
 
+	if (!haveDeco)
+		decoTimer->start();
+	else
+		checkDecoDuration(measureDuration.elapsed());
+}
+
+void ProfileWidget2::plotDeco()
+{
+	QTime measureDuration;
+	measureDuration.start();
+
+	// the dive we deferred this for might be gone by now
+	if (currentState != PROFILE || !dataModel->rowCount())
+		return;
+	dataModel->calculateDecompression();
+	// the tooltip has the details of the entries without deco memoized
+	toolTipItem->setPlotInfo(dataModel->data());
+	checkDecoDuration(measureDuration.elapsed());
+}
+
+void ProfileWidget2::checkDecoDuration(int elapsed)
+{
 	// OK, how long did this take us? Anything above the second is way too long,
 	// so if we are calculation TTS / NDL then let's force that off.
-	if (measureDuration.elapsed() > 1000 && prefs.calcndltts) {
+	if (elapsed > 1000 && prefs.calcndltts) {
 		MainWindow::instance()->turnOffNdlTts();
 		MainWindow::instance()->getNotificationWidget()->showNotification(tr("Show NDL / TTS was disabled because of excessive processing time"), KMessageWidget::Error);
 	}
@@ -910,6 +1028,8 @@ void ProfileWidget2::setEmptyState()
 #define HIDE_ALL(TYPE, CONTAINER) \
 	Q_FOREACH (TYPE *item, CONTAINER) item->setVisible(false);
 	HIDE_ALL(DiveCalculatedTissue, allTissues);
+	HIDE_ALL(DiveGFCeilingItem, allGFCeilings);
+	HIDE_ALL(DiveComputerCompareItem, compareItems);
 	HIDE_ALL(DivePercentageItem, allPercentages);
 	HIDE_ALL(DiveEventItem, eventItems);
 	HIDE_ALL(DiveHandler, handles);
@@ -1025,6 +1145,9 @@ void ProfileWidget2::setProfileState()
 			tissue->setVisible(true);
 		}
 	}
+	Q_FOREACH (DiveGFCeilingItem *gfCeiling, allGFCeilings) {
+		gfCeiling->settingsChanged();
+	}
 
 	if (prefs.percentagegraph) {
 		Q_FOREACH (DivePercentageItem *percentage, allPercentages) {
@@ -1192,8 +1315,12 @@ void ProfileWidget2::contextMenuEvent(QContextMenuEvent *event)
 			// create menu to show when right clicking on dive computer name
 			if (dc_number > 0)
 				m.addAction(tr("Make first divecomputer"), this, SLOT(makeFirstDC()));
-			if (count_divecomputers() > 1)
+			if (count_divecomputers() > 1) {
 				m.addAction(tr("Delete this divecomputer"), this, SLOT(deleteCurrentDC()));
+				QAction *compare = m.addAction(tr("Compare dive computers"), this, SLOT(toggleCompareDCs()));
+				compare->setCheckable(true);
+				compare->setChecked(compareDCs);
+			}
 			m.exec(event->globalPos());
 			// don't show the regular profile context menu
 			return;
@@ -1302,6 +1429,44 @@ void ProfileWidget2::deleteCurrentDC()
 	MainWindow::instance()->refreshDisplay();
 }
 
+void ProfileWidget2::toggleCompareDCs()
+{
+	compareDCs = !compareDCs;
+	plotComparedDCs(select_dc(&displayed_dive));
+}
+
+/* Show the depth, temperature and pressure of the other dive computers of the
+ * dive on top of the one selected. Their plot info comes from the same cache as
+ * the one shown, so switching between the dive computers or toggling this doesn't
+ * calculate anything again once each was plotted. The axes already fit all of
+ * them, calculate_max_limits_new() looks at the samples of every dive computer.
+ */
+void ProfileWidget2::plotComparedDCs(struct divecomputer *currentdc)
+{
+	struct divecomputer *dc = &displayed_dive.dc;
+	int nr = 0;
+
+	Q_FOREACH (DivePlotDataModel *compareModel, compareModels)
+		compareModel->clear();
+	if (compareDCs && currentState == PROFILE && !printMode) {
+		for (; dc && nr < compareModels.count(); dc = dc->next) {
+			if (dc == currentdc || !dc->samples)
+				continue;
+			struct plot_info pi;
+			create_plot_info_cached(&displayed_dive, dc, &pi);
+			QString dcName = get_dc_nickname(dc->model, dc->deviceid);
+			for (int i = 0; i < 3; i++)
+				compareItems[3 * nr + i]->setName(dcName);
+			compareModels[nr]->setDive(&displayed_dive, pi);
+			release_plot_info(&pi);
+			compareModels[nr]->emitDataChanged();
+			nr++;
+		}
+	}
+	for (int i = 0; i < compareItems.count(); i++)
+		compareItems[i]->setVisible(i / 3 < nr);
+}
+
 void ProfileWidget2::makeFirstDC()
 {
 	make_first_dc();
@@ -1483,6 +1648,8 @@ void ProfileWidget2::editName()
 void ProfileWidget2::disconnectTemporaryConnections()
 {
 	DivePlannerPointsModel *plannerModel = DivePlannerPointsModel::instance();
+	// a pending replan belongs to the state we are leaving
+	replanTimer->stop();
 	disconnect(plannerModel, SIGNAL(dataChanged(QModelIndex, QModelIndex)), this, SLOT(replot()));
 	disconnect(plannerModel, SIGNAL(cylinderModelEdited()), this, SLOT(replot()));
 
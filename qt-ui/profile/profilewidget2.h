@@ -40,6 +40,8 @@ class PercentageItem;
 class DiveGasPressureItem;
 class DiveCalculatedCeiling;
 class DiveCalculatedTissue;
+class DiveGFCeilingItem;
+class DiveComputerCompareItem;
 class PartialPressureGasItem;
 class PartialGasPressureAxis;
 class AbstractProfilePolygonItem;
@@ -47,6 +49,7 @@ class TankItem;
 class DiveHandler;
 class QGraphicsSimpleTextItem;
 class QModelIndex;
+class QTimer;
 class DivePictureItem;
 
 class ProfileWidget2 : public QGraphicsView {
@@ -102,11 +105,14 @@ slots: // Necessary to call from QAction's signals.
 	void editName();
 	void makeFirstDC();
 	void deleteCurrentDC();
+	void toggleCompareDCs();
 	void pointInserted(const QModelIndex &parent, int start, int end);
 	void pointsRemoved(const QModelIndex &, int start, int end);
 	void plotPictures();
 	void setReplot(bool state);
 	void replot();
+	void replotNow();
+	void plotDeco();
 
 	/* this is called for every move on the handlers. maybe we can speed up this a bit? */
 	void recreatePlannedDive();
@@ -140,6 +146,8 @@ private: /*methods*/
 	void addItemsToScene();
 	void setupItemOnScene();
 	void disconnectTemporaryConnections();
+	void checkDecoDuration(int elapsed);
+	void plotComparedDCs(struct divecomputer *currentdc);
 	struct plot_data *getEntryFromPos(QPointF pos);
 
 private:
@@ -151,6 +159,8 @@ private:
 	ToolTipItem *toolTipItem;
 	bool isPlotZoomed;
 	bool replotEnabled;
+	QTimer *replanTimer;
+	QTimer *decoTimer;
 	// All those here should probably be merged into one structure,
 	// So it's esyer to replicate for more dives later.
 	// In the meantime, keep it here.
@@ -165,9 +175,14 @@ private:
 	DiveCartesianAxis *cylinderPressureAxis;
 	DiveGasPressureItem *gasPressureItem;
 	QList<DiveEventItem *> eventItems;
+	QList<DiveEventItem *> spareEventItems; // not used by the current dive, see plotDive()
 	DiveTextItem *diveComputerText;
 	DiveCalculatedCeiling *diveCeiling;
 	QList<DiveCalculatedTissue *> allTissues;
+	QList<DiveGFCeilingItem *> allGFCeilings;
+	// the other dive computers of the dive, each with a depth, temperature and pressure item
+	QList<DivePlotDataModel *> compareModels;
+	QList<DiveComputerCompareItem *> compareItems;
 	DiveReportedCeiling *reportedCeiling;
 	PartialPressureGasItem *pn2GasItem;
 	PartialPressureGasItem *pheGasItem;
@@ -202,6 +217,7 @@ private:
 	int maxtime;
 	int maxdepth;
 	double fontPrintScale;
+	bool compareDCs;
 };
 
 #endif // PROFILEWIDGET2_H
@@ -33,18 +33,21 @@ void RulerNodeItem2::setRuler(RulerItem2 *r)
 void RulerNodeItem2::recalculate()
 {
 	struct plot_data *data = pInfo.entry + (pInfo.nr - 1);
-	uint16_t count = 0;
 	if (x() < 0) {
 		setPos(0, y());
 	} else if (x() > timeAxis->posAtValue(data->sec)) {
 		setPos(timeAxis->posAtValue(data->sec), depthAxis->posAtValue(data->depth));
 	} else {
-		data = pInfo.entry;
-		count = 0;
-		while (timeAxis->posAtValue(data->sec) < x() && count < pInfo.nr) {
-			data = pInfo.entry + count;
-			count++;
+		// binary search for the first entry at or right of the node
+		int low = 0, high = pInfo.nr - 1;
+		while (low < high) {
+			int mid = (low + high) / 2;
+			if (timeAxis->posAtValue(pInfo.entry[mid].sec) < x())
+				low = mid + 1;
+			else
+				high = mid;
 		}
+		data = pInfo.entry + low;
 		setPos(timeAxis->posAtValue(data->sec), depthAxis->posAtValue(data->depth));
 		entry = data;
 	}
@@ -62,6 +65,8 @@ void RulerNodeItem2::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
 
 RulerItem2::RulerItem2() : source(new RulerNodeItem2()),
 	dest(new RulerNodeItem2()),
+	textSource(NULL),
+	textDest(NULL),
 	timeAxis(NULL),
 	depthAxis(NULL),
 	textItemBack(new QGraphicsRectItem(this)),
@@ -78,6 +83,11 @@ RulerItem2::RulerItem2() : source(new RulerNodeItem2()),
 	connect(PreferencesDialog::instance(), SIGNAL(settingsChanged()), this, SLOT(settingsChanged()));
 }
 
+RulerItem2::~RulerItem2()
+{
+	release_plot_info(&pInfo);
+}
+
 void RulerItem2::settingsChanged()
 {
 	ProfileWidget2 *profWidget = NULL;
@@ -111,8 +121,13 @@ void RulerItem2::recalculate()
 	}
 	QLineF line(startPoint, endPoint);
 	setLine(line);
-	compare_samples(source->entry, dest->entry, buffer, 500, 1);
-	text = QString(buffer);
+	// dragging a node mostly moves it within the same entry, don't walk the samples again
+	if (source->entry != textSource || dest->entry != textDest) {
+		compare_samples(source->entry, dest->entry, buffer, 500, 1);
+		text = QString(buffer);
+		textSource = source->entry;
+		textDest = dest->entry;
+	}
 
 	// draw text
 	QGraphicsView *view = scene()->views().first();
@@ -148,7 +163,11 @@ RulerNodeItem2 *RulerItem2::destNode() const
 
 void RulerItem2::setPlotInfo(plot_info info)
 {
+	// the nodes point into the same entries, so this holds them for all of us
+	hold_plot_info(&info);
+	release_plot_info(&pInfo);
 	pInfo = info;
+	textSource = textDest = NULL;
 	dest->setPlotInfo(info);
 	source->setPlotInfo(info);
 	dest->recalculate();
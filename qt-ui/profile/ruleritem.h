@@ -34,6 +34,7 @@ class RulerItem2 : public QObject, public QGraphicsLineItem {
 	Q_OBJECT
 public:
 	explicit RulerItem2();
+	~RulerItem2();
 	void recalculate();
 
 	void setPlotInfo(struct plot_info pInfo);
@@ -51,6 +52,7 @@ private:
 	QPointF startPoint, endPoint;
 	RulerNodeItem2 *source, *dest;
 	QString text;
+	struct plot_data *textSource, *textDest; // the entries 'text' was calculated for
 	int height;
 	int paint_direction;
 	DiveCartesianAxis *timeAxis;
@@ -54,10 +54,28 @@ void TankItem::setData(DivePlotDataModel *model, struct plot_info *plotInfo, str
 	modelDataChanged();
 }
 
-void TankItem::createBar(qreal x, qreal w, struct gasmix *gas)
+// bars (and their labels) are reused from one dive to the next, only the missing ones get created
+void TankItem::createBar(int bar, qreal x, qreal w, struct gasmix *gas)
 {
+	QGraphicsRectItem *rect;
+	DiveTextItem *label;
+
+	if (bar < rects.count()) {
+		rect = rects[bar];
+		label = labels[bar];
+		rect->setRect(x, 0, w, height);
+		rect->show();
+	} else {
+		rect = new QGraphicsRectItem(x, 0, w, height, this);
+		rect->setPen(QPen(QBrush(), 0.0)); // get rid of the thick line around the rectangle
+		rects.push_back(rect);
+		label = new DiveTextItem(rect);
+		label->setBrush(Qt::black);
+		label->setAlignment(Qt::AlignBottom | Qt::AlignRight);
+		label->setZValue(101);
+		labels.push_back(label);
+	}
 	// pick the right gradient, size, position and text
-	QGraphicsRectItem *rect = new QGraphicsRectItem(x, 0, w, height, this);
 	if (gasmix_is_air(gas))
 		rect->setBrush(air);
 	else if (gas->he.permille)
@@ -66,14 +84,8 @@ void TankItem::createBar(qreal x, qreal w, struct gasmix *gas)
 		rect->setBrush(oxygen);
 	else
 		rect->setBrush(nitrox);
-	rect->setPen(QPen(QBrush(), 0.0)); // get rid of the thick line around the rectangle
-	rects.push_back(rect);
-	DiveTextItem *label = new DiveTextItem(rect);
 	label->setText(gasname(gas));
-	label->setBrush(Qt::black);
 	label->setPos(x + 1, 0);
-	label->setAlignment(Qt::AlignBottom | Qt::AlignRight);
-	label->setZValue(101);
 }
 
 void TankItem::modelDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
@@ -83,16 +95,10 @@ void TankItem::modelDataChanged(const QModelIndex &topLeft, const QModelIndex &b
 	if (!dataModel || !pInfoEntry || !pInfoNr)
 		return;
 
-	// remove the old rectangles
-	foreach (QGraphicsRectItem *r, rects) {
-		delete(r);
-	}
-	rects.clear();
-
 	// walk the list and figure out which tanks go where
 	struct plot_data *entry = pInfoEntry;
 	int cylIdx = entry->cylinderindex;
-	int i = -1;
+	int i = -1, bar = 0;
 	int startTime = 0;
 	struct gasmix *gas = &diveCylinderStore.cylinder[cylIdx].gasmix;
 	qreal width, left;
@@ -102,14 +108,18 @@ void TankItem::modelDataChanged(const QModelIndex &topLeft, const QModelIndex &b
 			continue;
 		width = hAxis->posAtValue(entry->sec) - hAxis->posAtValue(startTime);
 		left = hAxis->posAtValue(startTime);
-		createBar(left, width, gas);
+		createBar(bar++, left, width, gas);
 		cylIdx = entry->cylinderindex;
 		gas = &diveCylinderStore.cylinder[cylIdx].gasmix;
 		startTime = entry->sec;
 	}
 	width = hAxis->posAtValue(entry->sec) - hAxis->posAtValue(startTime);
 	left = hAxis->posAtValue(startTime);
-	createBar(left, width, gas);
+	createBar(bar++, left, width, gas);
+
+	// hide the bars the previous dive needed but this one doesn't
+	for (; bar < rects.count(); bar++)
+		rects[bar]->hide();
 }
 
 void TankItem::setHorizontalAxis(DiveCartesianAxis *horizontal)
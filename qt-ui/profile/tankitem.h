@@ -25,7 +25,7 @@ public slots:
 	virtual void modelDataChanged(const QModelIndex &topLeft = QModelIndex(), const QModelIndex &bottomRight = QModelIndex());
 
 private:
-	void createBar(qreal x, qreal w, struct gasmix *gas);
+	void createBar(int bar, qreal x, qreal w, struct gasmix *gas);
 	DivePlotDataModel *dataModel;
 	DiveCartesianAxis *hAxis;
 	int hDataColumn;
@@ -35,6 +35,7 @@ private:
 	qreal yPos, height;
 	QBrush air, nitrox, oxygen, trimix;
 	QList<QGraphicsRectItem *> rects;
+	QList<DiveTextItem *> labels;
 };
 
 #endif // TANKITEM_H
@@ -900,3 +900,25 @@ void learnImages(const QDir dir, int max_recursions, bool recursed)
 
 	QtConcurrent::blockingMap(files, hashFile);
 }
+
+struct ParallelItem {
+	void (*fn)(void *);
+	void *data;
+};
+
+static void runParallelItem(ParallelItem &item)
+{
+	item.fn(item.data);
+}
+
+extern "C" void parallel_for_each(void *array, int nr, size_t size, void (*fn)(void *))
+{
+	QVector<ParallelItem> items(nr);
+	char *p = (char *)array;
+
+	for (int i = 0; i < nr; i++) {
+		items[i].fn = fn;
+		items[i].data = p + i * size;
+	}
+	QtConcurrent::blockingMap(items, runParallelItem);
+}
@@ -14,6 +14,7 @@
 #include "device.h"
 #include "membuffer.h"
 #include "version.h"
+#include "sha1.h"
 
 /*
  * handle libgit2 revision 0.20 and earlier
@@ -34,6 +35,22 @@
 #else
   #define git_treebuilder_write(id, repo, bld)   git_treebuilder_write(id, bld)
 #endif
+/*
+ * staging objects in memory needs the mempack backend, and
+ * git_buf_free() was renamed in libgit2 revision 0.28
+ */
+#if LIBGIT2_VER_MAJOR || LIBGIT2_VER_MINOR >= 22
+  #define STAGE_OBJECTS_IN_MEMORY
+  #include <git2/sys/odb_backend.h>
+  #include <git2/sys/mempack.h>
+  #include <git2/sys/repository.h>
+  #if !LIBGIT2_VER_MAJOR && LIBGIT2_VER_MINOR < 28
+    #define git_buf_dispose git_buf_free
+  #endif
+  #if LIBGIT2_VER_MAJOR
+    #define git_transfer_progress git_indexer_progress
+  #endif
+#endif
 
 #define VA_BUF(b, fmt) do { va_list args; va_start(args, fmt); put_vformat(b, fmt, args); va_end(args); } while (0)
 
@@ -416,15 +433,27 @@ const char *get_error_string(void)
 	return str;
 }
 
+/*
+ * Loading git dive logs parses the dive computer files on
+ * several threads, so errors can come in from all of them.
+ * They are rare, so a simple spinlock will do.
+ */
+static int error_lock;
+
 int report_error(const char *fmt, ...)
 {
 	struct membuffer *buf = &error_string_buffer;
 
+	while (__sync_lock_test_and_set(&error_lock, 1))
+		/* nothing */;
+
 	/* Previous unprinted errors? Add a newline in between */
 	if (buf->len)
 		put_bytes(buf, "\n", 1);
 	VA_BUF(buf, fmt);
 	mb_cstring(buf);
+
+	__sync_lock_release(&error_lock);
 	return -1;
 }
 
@@ -440,13 +469,268 @@ int report_error(const char *fmt, ...)
  * When finally writing it out, we traverse the subdirectories depth-
  * first, writing them out, and then adding the written-out trees to
  * the git_treebuilder they existed in.
+ *
+ * Dive and trip directories also get a key: a hash of everything
+ * that goes into them. If we wrote a tree with the same key before,
+ * the directory has no treebuilder at all, and 'id' is that tree.
+ * A dive directory tells its dive the id of the tree it ends up as.
  */
 struct dir {
 	git_treebuilder *files;
 	struct dir *subdirs, *sibling;
-	char unique, name[1];
+	struct dive *dive;
+	git_oid id;
+	unsigned char key[20];
+	char unique, keyed, name[1];
 };
 
+/*
+ * Regenerating the text of every dive is what makes saving a big
+ * dive log slow, even when only one dive changed. So we remember the
+ * trees written by the last save, by key, and reuse them for every
+ * dive and trip that is still the same. The trees are only known to
+ * exist in the repository they were written to, and we start over
+ * when saving somewhere else.
+ */
+struct cached_tree {
+	unsigned char key[20];
+	git_oid id;
+	bool used;
+};
+
+struct tree_cache {
+	unsigned int nr, size;
+	struct cached_tree *trees;
+};
+
+static struct tree_cache saved_trees, written_trees;
+static char *tree_cache_repo;
+static bool reuse_trees;
+
+static unsigned int tree_hash(const unsigned char *key)
+{
+	unsigned int hash;
+
+	/* The key is a SHA1 already */
+	memcpy(&hash, key, sizeof(hash));
+	return hash;
+}
+
+static struct cached_tree *find_cached_tree(struct tree_cache *cache, const unsigned char *key)
+{
+	unsigned int i;
+
+	if (!cache->size)
+		return NULL;
+	for (i = tree_hash(key); cache->trees[i & (cache->size - 1)].used; i++) {
+		struct cached_tree *tree = cache->trees + (i & (cache->size - 1));
+		if (!memcmp(tree->key, key, sizeof(tree->key)))
+			return tree;
+	}
+	return NULL;
+}
+
+static void insert_cached_tree(struct tree_cache *cache, const unsigned char *key, const git_oid *id)
+{
+	struct cached_tree *tree;
+	unsigned int i;
+
+	for (i = tree_hash(key); (tree = cache->trees + (i & (cache->size - 1)))->used; i++) {
+		/* Identical dives have identical trees */
+		if (!memcmp(tree->key, key, sizeof(tree->key)))
+			return;
+	}
+	memcpy(tree->key, key, sizeof(tree->key));
+	git_oid_cpy(&tree->id, id);
+	tree->used = true;
+	cache->nr++;
+}
+
+static void add_cached_tree(struct tree_cache *cache, const unsigned char *key, const git_oid *id)
+{
+	/* Keep it at most half full */
+	if (2 * (cache->nr + 1) > cache->size) {
+		struct tree_cache new = { 0 };
+		unsigned int i;
+
+		new.size = cache->size ? 2 * cache->size : 1024;
+		new.trees = calloc(new.size, sizeof(struct cached_tree));
+		if (!new.trees)
+			return;
+		for (i = 0; i < cache->size; i++) {
+			struct cached_tree *tree = cache->trees + i;
+			if (tree->used)
+				insert_cached_tree(&new, tree->key, &tree->id);
+		}
+		free(cache->trees);
+		*cache = new;
+	}
+	insert_cached_tree(cache, key, id);
+}
+
+static void free_tree_cache(struct tree_cache *cache)
+{
+	free(cache->trees);
+	memset(cache, 0, sizeof(*cache));
+}
+
+static void start_tree_cache(git_repository *repo)
+{
+	const char *path = git_repository_path(repo);
+
+	if (!tree_cache_repo || strcmp(tree_cache_repo, path)) {
+		free_tree_cache(&saved_trees);
+		free(tree_cache_repo);
+		tree_cache_repo = strdup(path);
+	}
+	reuse_trees = true;
+}
+
+/* What we wrote this time is what the next save can reuse */
+static void finish_tree_cache(bool success)
+{
+	if (!reuse_trees)
+		return;
+	reuse_trees = false;
+	if (success) {
+		free_tree_cache(&saved_trees);
+		saved_trees = written_trees;
+		memset(&written_trees, 0, sizeof(written_trees));
+	} else {
+		free_tree_cache(&written_trees);
+	}
+}
+
+/*
+ * Saving a big dive log creates tens of thousands of objects, and
+ * as loose objects every one of them is a file of its own. So while
+ * we save, the repository gets an object database that keeps new
+ * objects in memory and finds the old ones on disk. Once we have
+ * the commit, the objects this save created go out as a single
+ * pack through the real object database.
+ *
+ * git_mempack_dump() would pack everything the commit can reach,
+ * so we remember what we wrote and pack just that.
+ */
+#ifdef STAGE_OBJECTS_IN_MEMORY
+static git_odb *repo_odb, *staging_odb;
+static git_odb_backend *mempack;
+static git_oid *staged_ids;
+static int nr_staged_ids, allocated_staged_ids;
+
+static void finish_object_staging(git_repository *repo)
+{
+	nr_staged_ids = 0;
+	if (!staging_odb)
+		return;
+	git_repository_set_odb(repo, repo_odb);
+	git_odb_free(staging_odb);
+	git_odb_free(repo_odb);
+	staging_odb = NULL;
+	repo_odb = NULL;
+	mempack = NULL;
+}
+
+static void start_object_staging(git_repository *repo)
+{
+	struct membuffer objects = { 0 };
+	git_odb_backend *backend;
+	int ret;
+
+	/* If any of this fails, we just write loose objects like we used to */
+	if (git_repository_odb(&repo_odb, repo))
+		return;
+	if (git_odb_new(&staging_odb))
+		goto fail;
+	if (git_mempack_new(&backend))
+		goto fail;
+	if (git_odb_add_backend(staging_odb, backend, 999)) {
+		backend->free(backend);
+		goto fail;
+	}
+	mempack = backend;
+
+	put_format(&objects, "%sobjects", git_repository_path(repo));
+	ret = git_odb_add_disk_alternate(staging_odb, mb_cstring(&objects));
+	free_buffer(&objects);
+	if (ret)
+		goto fail;
+
+	git_repository_set_odb(repo, staging_odb);
+	return;
+
+fail:
+	git_odb_free(staging_odb);
+	git_odb_free(repo_odb);
+	staging_odb = NULL;
+	repo_odb = NULL;
+	mempack = NULL;
+}
+
+static void stage_object(const git_oid *id)
+{
+	if (!mempack)
+		return;
+	if (nr_staged_ids >= allocated_staged_ids) {
+		allocated_staged_ids = (nr_staged_ids + 32) * 3 / 2;
+		staged_ids = realloc(staged_ids, allocated_staged_ids * sizeof(git_oid));
+		if (!staged_ids)
+			exit(1);
+	}
+	git_oid_cpy(staged_ids + nr_staged_ids++, id);
+}
+
+static int write_staged_pack(git_repository *repo)
+{
+	git_buf pack = { 0 };
+	git_packbuilder *pb;
+	git_odb_writepack *writepack;
+	git_transfer_progress stats = { 0 };
+	int i, ret;
+
+	ret = git_packbuilder_new(&pb, repo);
+	if (ret)
+		return ret;
+	git_packbuilder_set_threads(pb, 0);
+
+	/* Writing an object that is already on disk doesn't stage it */
+	for (i = 0; i < nr_staged_ids && !ret; i++) {
+		if (!git_odb_exists(repo_odb, staged_ids + i))
+			ret = git_packbuilder_insert(pb, staged_ids + i, NULL);
+	}
+	if (!ret && git_packbuilder_object_count(pb))
+		ret = git_packbuilder_write_buf(&pack, pb);
+	git_packbuilder_free(pb);
+
+	if (!ret && pack.size) {
+		ret = git_odb_write_pack(&writepack, repo_odb, NULL, NULL);
+		if (!ret) {
+			ret = writepack->append(writepack, pack.ptr, pack.size, &stats);
+			if (!ret)
+				ret = writepack->commit(writepack, &stats);
+			writepack->free(writepack);
+		}
+	}
+	git_buf_dispose(&pack);
+	return ret;
+}
+
+static int flush_staged_objects(git_repository *repo)
+{
+	int ret = 0;
+
+	if (mempack)
+		ret = write_staged_pack(repo);
+	finish_object_staging(repo);
+	return ret;
+}
+#else
+static void start_object_staging(git_repository *repo) { }
+static void stage_object(const git_oid *id) { }
+static int flush_staged_objects(git_repository *repo) { return 0; }
+static void finish_object_staging(git_repository *repo) { }
+#endif
+
 static int tree_insert(git_treebuilder *dir, const char *name, int mkunique, git_oid *id, unsigned mode)
 {
 	int ret;
@@ -487,6 +771,8 @@ static struct dir *new_directory(git_repository *repo, struct dir *parent, struc
 	git_treebuilder_new(&subdir->files, repo, NULL);
 	memcpy(subdir->name, name, len);
 	subdir->unique = 0;
+	subdir->keyed = 0;
+	subdir->dive = NULL;
 	subdir->name[len] = 0;
 
 	/* Add it to the list of subdirs of the parent */
@@ -496,6 +782,25 @@ static struct dir *new_directory(git_repository *repo, struct dir *parent, struc
 	return subdir;
 }
 
+/*
+ * Remember what goes into this directory, and if the last save wrote
+ * the same thing, use that tree rather than filling the directory in.
+ */
+static bool reuse_tree(struct dir *dir, const unsigned char *key)
+{
+	struct cached_tree *old;
+
+	memcpy(dir->key, key, sizeof(dir->key));
+	dir->keyed = 1;
+	old = find_cached_tree(&saved_trees, key);
+	if (!old)
+		return false;
+	git_oid_cpy(&dir->id, &old->id);
+	git_treebuilder_free(dir->files);
+	dir->files = NULL;
+	return true;
+}
+
 static struct dir *mktree(git_repository *repo, struct dir *dir, const char *fmt, ...)
 {
 	struct membuffer buf = { 0 };
@@ -557,6 +862,7 @@ static int blob_insert(git_repository *repo, struct dir *tree, struct membuffer
 	free_buffer(b);
 	if (ret)
 		return ret;
+	stage_object(&blob_id);
 
 	VA_BUF(&name, fmt);
 	ret = tree_insert(tree->files, mb_cstring(&name), 1, &blob_id, GIT_FILEMODE_BLOB);
@@ -622,8 +928,17 @@ static int save_one_dive(git_repository *repo, struct dir *tree, struct dive *di
 	create_dive_name(dive, &name, tm);
 	subdir = new_directory(repo, tree, &name);
 	subdir->unique = 1;
+	subdir->dive = dive;
 	free_buffer(&name);
 
+	if (reuse_trees) {
+		unsigned char key[20];
+
+		hash_dive(dive, key);
+		if (reuse_tree(subdir, key))
+			return 0;
+	}
+
 	create_dive_buffer(dive, &buf);
 	nr = dive->number;
 	ret = blob_insert(repo, subdir, &buf,
@@ -696,24 +1011,27 @@ static void create_trip_name(dive_trip_t *trip, struct membuffer *name, struct t
 	put_string(name, "trip");
 }
 
-static int save_trip_description(git_repository *repo, struct dir *dir, dive_trip_t *trip, struct tm *tm)
+static void create_trip_description(dive_trip_t *trip, struct membuffer *desc, struct tm *tm)
 {
-	int ret;
-	git_oid blob_id;
-	struct membuffer desc = { 0 };
-
-	put_format(&desc, "date %04u-%02u-%02u\n",
+	put_format(desc, "date %04u-%02u-%02u\n",
 		   tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday);
-	put_format(&desc, "time %02u:%02u:%02u\n",
+	put_format(desc, "time %02u:%02u:%02u\n",
 		   tm->tm_hour, tm->tm_min, tm->tm_sec);
 
-	show_utf8(&desc, "location ", trip->location, "\n");
-	show_utf8(&desc, "notes ", trip->notes, "\n");
+	show_utf8(desc, "location ", trip->location, "\n");
+	show_utf8(desc, "notes ", trip->notes, "\n");
+}
 
-	ret = git_blob_create_frombuffer(&blob_id, repo, desc.buffer, desc.len);
-	free_buffer(&desc);
+static int save_trip_description(git_repository *repo, struct dir *dir, struct membuffer *desc)
+{
+	int ret;
+	git_oid blob_id;
+
+	ret = git_blob_create_frombuffer(&blob_id, repo, desc->buffer, desc->len);
+	free_buffer(desc);
 	if (ret)
 		return report_error("trip blob creation failed");
+	stage_object(&blob_id);
 	ret = tree_insert(dir->files, "00-Trip", 0, &blob_id, GIT_FILEMODE_BLOB);
 	if (ret)
 		return report_error("trip description tree insert failed");
@@ -733,6 +1051,33 @@ static void verify_shared_date(timestamp_t when, struct tm *tm)
 		tm->tm_mon = -1;
 }
 
+/*
+ * A trip directory holds the trip description and its dives, under
+ * names that depend on the date of the trip.
+ */
+static void hash_trip(dive_trip_t *trip, struct membuffer *desc, struct tm *tm, unsigned char key[20])
+{
+	int i;
+	struct dive *dive;
+	SHA_CTX ctx;
+
+	SHA1_Init(&ctx);
+	SHA1_Update(&ctx, desc->buffer, desc->len);
+	for_each_dive(i, dive) {
+		struct membuffer name = { 0 };
+		unsigned char dive_key[20];
+
+		if (dive->divetrip != trip)
+			continue;
+		create_dive_name(dive, &name, tm);
+		SHA1_Update(&ctx, mb_cstring(&name), name.len + 1);
+		free_buffer(&name);
+		hash_dive(dive, dive_key);
+		SHA1_Update(&ctx, dive_key, sizeof(dive_key));
+	}
+	SHA1_Final(key, &ctx);
+}
+
 #define MIN_TIMESTAMP (0)
 #define MAX_TIMESTAMP (0x7fffffffffffffff)
 
@@ -741,7 +1086,7 @@ static int save_one_trip(git_repository *repo, struct dir *tree, dive_trip_t *tr
 	int i;
 	struct dive *dive;
 	struct dir *subdir;
-	struct membuffer name = { 0 };
+	struct membuffer name = { 0 }, desc = { 0 };
 	timestamp_t first, last;
 
 	/* Create trip directory */
@@ -750,8 +1095,7 @@ static int save_one_trip(git_repository *repo, struct dir *tree, dive_trip_t *tr
 	subdir->unique = 1;
 	free_buffer(&name);
 
-	/* Trip description file */
-	save_trip_description(repo, subdir, trip, tm);
+	create_trip_description(trip, &desc, tm);
 
 	/* Make sure we write out the dates to the dives consistently */
 	first = MAX_TIMESTAMP;
@@ -767,6 +1111,19 @@ static int save_one_trip(git_repository *repo, struct dir *tree, dive_trip_t *tr
 	verify_shared_date(first, tm);
 	verify_shared_date(last, tm);
 
+	if (reuse_trees) {
+		unsigned char key[20];
+
+		hash_trip(trip, &desc, tm, key);
+		if (reuse_tree(subdir, key)) {
+			free_buffer(&desc);
+			return 0;
+		}
+	}
+
+	/* Trip description file */
+	save_trip_description(repo, subdir, &desc);
+
 	/* Save each dive in the directory */
 	for_each_dive(i, dive) {
 		if (dive->divetrip == trip)
@@ -1048,11 +1405,16 @@ static int create_new_commit(git_repository *repo, const char *branch, git_oid *
 		if (git_commit_create_v(&commit_id, repo, NULL, author, author, NULL, mb_cstring(&commit_msg), tree, parent != NULL, parent))
 			return report_error("Git commit create failed (%s)", strerror(errno));
 		free_buffer(&commit_msg);
+		stage_object(&commit_id);
 
 		if (git_commit_lookup(&commit, repo, &commit_id))
 			return report_error("Could not look up newly created commit");
 	}
 
+	/* The branch must not point to anything that is still only in memory */
+	if (flush_staged_objects(repo))
+		return report_error("Failed to write the objects of the save to '%s'", branch);
+
 	if (!ref) {
 		if (git_branch_create(&ref, repo, branch, commit, 0, author, "Create branch"))
 			return report_error("Failed to create branch '%s'", branch);
@@ -1087,6 +1449,15 @@ static int write_git_tree(git_repository *repo, struct dir *tree, git_oid *resul
 	int ret;
 	struct dir *subdir;
 
+	/* A tree the last save wrote: nothing to do but remember it again */
+	if (!tree->files) {
+		git_oid_cpy(result, &tree->id);
+		add_cached_tree(&written_trees, tree->key, result);
+		if (tree->dive)
+			memcpy(tree->dive->git_id, result->id, sizeof(tree->dive->git_id));
+		return 0;
+	}
+
 	/* Write out our subdirectories, add them to the treebuilder, and free them */
 	while ((subdir = tree->subdirs) != NULL) {
 		git_oid id;
@@ -1099,6 +1470,12 @@ static int write_git_tree(git_repository *repo, struct dir *tree, git_oid *resul
 
 	/* .. write out the resulting treebuilder */
 	ret = git_treebuilder_write(result, repo, tree->files);
+	if (!ret)
+		stage_object(result);
+	if (!ret && tree->keyed)
+		add_cached_tree(&written_trees, tree->key, result);
+	if (!ret && tree->dive)
+		memcpy(tree->dive->git_id, result->id, sizeof(tree->dive->git_id));
 
 	/* .. and free the now useless treebuilder */
 	git_treebuilder_free(tree->files);
@@ -1113,19 +1490,46 @@ static int do_git_save(git_repository *repo, const char *branch, bool select_onl
 
 	/* Start with an empty tree: no subdirectories, no files */
 	tree.name[0] = 0;
+	tree.keyed = 0;
+	tree.dive = NULL;
 	tree.subdirs = NULL;
 	if (git_treebuilder_new(&tree.files, repo, NULL))
 		return report_error("git treebuilder failed");
 
+	/* Saving just the selected dives would leave us remembering only those */
+	if (!select_only)
+		start_tree_cache(repo);
+	start_object_staging(repo);
+
 	/* Populate our tree data structure */
-	if (create_git_tree(repo, &tree, select_only))
+	if (create_git_tree(repo, &tree, select_only)) {
+		finish_object_staging(repo);
+		finish_tree_cache(false);
 		return -1;
+	}
 
-	if (write_git_tree(repo, &tree, &id))
+	if (write_git_tree(repo, &tree, &id)) {
+		finish_object_staging(repo);
+		finish_tree_cache(false);
 		return report_error("git tree write failed");
+	}
 
 	/* And save the tree! */
-	return create_new_commit(repo, branch, &id);
+	if (create_new_commit(repo, branch, &id)) {
+		finish_object_staging(repo);
+		finish_tree_cache(false);
+		return -1;
+	}
+	finish_object_staging(repo);
+	finish_tree_cache(true);
+
+	/* The next load of this commit can use what we have in memory right now */
+	if (!select_only) {
+		char *snapshot = git_snapshot_name(repo);
+		save_snapshot(snapshot, saved_git_id);
+		free(snapshot);
+	}
+	return 0;
 }
 
 int git_save_dives(struct git_repository *repo, const char *branch, bool select_only)
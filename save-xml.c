@@ -646,6 +646,8 @@ int save_dives_logic(const char *filename, const bool select_only)
 	}
 	if (error)
 		report_error("Save failed (%s)", strerror(errno));
+	else if (!select_only && prefs.default_filename && !strcmp(filename, prefs.default_filename))
+		save_file_snapshot(filename);
 
 	free_buffer(&buf);
 	return error;
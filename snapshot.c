@@ -0,0 +1,829 @@
+/* snapshot.c */
+/*
+ * A binary snapshot of a whole dive log, so that opening the same log
+ * again doesn't have to parse it from scratch.
+ *
+ * The snapshot is simply our in-memory structures written out, with
+ * every pointer followed by the data it points to. That makes it only
+ * valid for the build that wrote it, but loading it is little more
+ * than a few memcpy's from the mapped file - the samples, which are
+ * the bulk of it, are copied over as whole arrays.
+ *
+ * Every snapshot carries a key that says what it was made from: the
+ * size and modification time of an XML file, or the commit id of a
+ * git repository. If the magic, version, structure sizes or key don't
+ * match, or the file turns out to be damaged, loading fails and the
+ * caller just parses the real thing instead.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dive.h"
+#include "divelist.h"
+#include "device.h"
+#include "file.h"
+#include "membuffer.h"
+#include "sha1.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#define SNAPSHOT_MAGIC "SSRFSNAP"
+#define SNAPSHOT_VERSION 1
+
+enum snapshot_record {
+	SNAPSHOT_END,
+	SNAPSHOT_DEVICE,
+	SNAPSHOT_SITE,
+	SNAPSHOT_TRIP,
+	SNAPSHOT_TRIP_END,
+	SNAPSHOT_DIVE
+};
+
+/* Any change to these structures invalidates old snapshots */
+static const uint32_t snapshot_sizes[] = {
+	sizeof(struct dive), sizeof(struct divecomputer), sizeof(struct sample),
+	sizeof(struct event), sizeof(struct picture), sizeof(struct dive_site)
+};
+
+#define NR_SIZES (sizeof(snapshot_sizes) / sizeof(snapshot_sizes[0]))
+
+/*
+ * The devices and tags of a snapshot go into lists everybody sees, so they
+ * are only added once all of the snapshot was read. Until then they wait
+ * in the reader.
+ */
+struct snapshot_device {
+	char *model, *nickname, *serial, *firmware;
+	uint32_t deviceid;
+	struct snapshot_device *next;
+};
+
+struct snapshot_tag {
+	struct dive *dive;
+	char *tag;
+	struct snapshot_tag *next;
+};
+
+struct snapshot_reader {
+	const char *p, *end;
+	bool error;
+	struct snapshot_device *devices, **last_device;
+	struct snapshot_tag *tags, **last_tag;
+};
+
+static void put_u32(struct membuffer *b, uint32_t val)
+{
+	put_bytes(b, (const char *)&val, sizeof(val));
+}
+
+/* NULL and the empty string are different things */
+static void put_str(struct membuffer *b, const char *s)
+{
+	if (!s) {
+		put_u32(b, ~0u);
+		return;
+	}
+	put_u32(b, strlen(s));
+	put_string(b, s);
+}
+
+#define put_raw(b, p) put_bytes(b, (const char *)(p), sizeof(*(p)))
+
+static bool get_bytes(struct snapshot_reader *r, void *dst, size_t len)
+{
+	if (r->error || (size_t)(r->end - r->p) < len) {
+		r->error = true;
+		memset(dst, 0, len);
+		return false;
+	}
+	memcpy(dst, r->p, len);
+	r->p += len;
+	return true;
+}
+
+static uint32_t get_u32(struct snapshot_reader *r)
+{
+	uint32_t val;
+
+	get_bytes(r, &val, sizeof(val));
+	return val;
+}
+
+static char *get_str(struct snapshot_reader *r)
+{
+	uint32_t len = get_u32(r);
+	char *s;
+
+	if (r->error || len == ~0u)
+		return NULL;
+	if ((size_t)(r->end - r->p) < len) {
+		r->error = true;
+		return NULL;
+	}
+	s = malloc(len + 1);
+	if (!s)
+		exit(1);
+	memcpy(s, r->p, len);
+	s[len] = 0;
+	r->p += len;
+	return s;
+}
+
+#define get_raw(r, p) get_bytes(r, p, sizeof(*(p)))
+
+static void write_device(void *_b, const char *model, uint32_t deviceid,
+			 const char *nickname, const char *serial, const char *firmware)
+{
+	struct membuffer *b = _b;
+
+	put_u32(b, SNAPSHOT_DEVICE);
+	put_str(b, model);
+	put_u32(b, deviceid);
+	put_str(b, nickname);
+	put_str(b, serial);
+	put_str(b, firmware);
+}
+
+static void write_site(struct membuffer *b, struct dive_site *ds)
+{
+	put_u32(b, SNAPSHOT_SITE);
+	put_raw(b, ds);
+	put_str(b, ds->name);
+	put_str(b, ds->description);
+	put_str(b, ds->notes);
+}
+
+/*
+ * The pointers differ between copies of the same dive, so the hash
+ * of a dive leaves them out. What they point to goes in anyway.
+ */
+static void clear_dc_pointers(struct divecomputer *dc)
+{
+	dc->model = dc->serial = dc->fw_version = NULL;
+	dc->alloc_samples = 0;
+	dc->sample = NULL;
+	dc->events = NULL;
+	dc->extra_data = NULL;
+	dc->next = NULL;
+}
+
+static void clear_dive_pointers(struct dive *dive)
+{
+	int i;
+
+	dive->divetrip = NULL;
+	dive->next = NULL;
+	dive->pprev = NULL;
+	dive->notes = dive->divemaster = dive->buddy = dive->suit = NULL;
+	for (i = 0; i < MAX_CYLINDERS; i++)
+		dive->cylinder[i].type.description = NULL;
+	for (i = 0; i < MAX_WEIGHTSYSTEMS; i++)
+		dive->weightsystem[i].description = NULL;
+	dive->tag_list = NULL;
+	dive->picture_list = NULL;
+	clear_dc_pointers(&dive->dc);
+}
+
+static void write_dc(struct membuffer *b, struct divecomputer *dc, bool by_value)
+{
+	struct event *ev;
+	struct extra_data *ed;
+	int nr;
+
+	if (by_value) {
+		struct divecomputer copy;
+
+		memcpy(&copy, dc, sizeof(copy));
+		clear_dc_pointers(&copy);
+		put_raw(b, &copy);
+	} else {
+		put_raw(b, dc);
+	}
+	put_str(b, dc->model);
+	put_str(b, dc->serial);
+	put_str(b, dc->fw_version);
+	put_bytes(b, (const char *)dc->sample, dc->samples * sizeof(struct sample));
+
+	for (nr = 0, ev = dc->events; ev; ev = ev->next)
+		nr++;
+	put_u32(b, nr);
+	for (ev = dc->events; ev; ev = ev->next) {
+		if (by_value) {
+			struct event copy;
+
+			memcpy(&copy, ev, sizeof(copy));
+			copy.next = NULL;
+			put_raw(b, &copy);
+		} else {
+			put_raw(b, ev);
+		}
+		put_str(b, ev->name);
+	}
+
+	for (nr = 0, ed = dc->extra_data; ed; ed = ed->next)
+		nr++;
+	put_u32(b, nr);
+	for (ed = dc->extra_data; ed; ed = ed->next) {
+		put_str(b, ed->key);
+		put_str(b, ed->value);
+	}
+}
+
+static void write_dive(struct membuffer *b, struct dive *dive, bool by_value)
+{
+	struct tag_entry *tag;
+	struct picture *pic;
+	struct divecomputer *dc;
+	int i, nr;
+
+	put_u32(b, SNAPSHOT_DIVE);
+	if (by_value) {
+		struct dive copy;
+
+		memcpy(&copy, dive, sizeof(copy));
+		clear_dive_pointers(&copy);
+		put_raw(b, &copy);
+	} else {
+		put_raw(b, dive);
+	}
+	put_str(b, dive->notes);
+	put_str(b, dive->divemaster);
+	put_str(b, dive->buddy);
+	put_str(b, dive->suit);
+	for (i = 0; i < MAX_CYLINDERS; i++)
+		put_str(b, dive->cylinder[i].type.description);
+	for (i = 0; i < MAX_WEIGHTSYSTEMS; i++)
+		put_str(b, dive->weightsystem[i].description);
+
+	/* Untranslated, so that loading them goes through the same lookup as the XML */
+	for (nr = 0, tag = dive->tag_list; tag; tag = tag->next)
+		nr++;
+	put_u32(b, nr);
+	for (tag = dive->tag_list; tag; tag = tag->next)
+		put_str(b, tag->tag->source ?: tag->tag->name);
+
+	for (nr = 0, pic = dive->picture_list; pic; pic = pic->next)
+		nr++;
+	put_u32(b, nr);
+	for (pic = dive->picture_list; pic; pic = pic->next) {
+		if (by_value) {
+			struct picture copy;
+
+			memcpy(&copy, pic, sizeof(copy));
+			copy.filename = copy.hash = NULL;
+			copy.next = NULL;
+			put_raw(b, &copy);
+		} else {
+			put_raw(b, pic);
+		}
+		put_str(b, pic->filename);
+		put_str(b, pic->hash);
+	}
+
+	/* The dc 'next' pointer in the raw data tells the loader if there are more */
+	for (dc = &dive->dc; dc; dc = dc->next)
+		write_dc(b, dc, by_value);
+}
+
+/*
+ * Like the XML file, we only remember what the user gave the trip,
+ * followed by its dives in dive table order.
+ */
+static void write_trip(struct membuffer *b, dive_trip_t *trip)
+{
+	struct dive *dive;
+	int i;
+
+	put_u32(b, SNAPSHOT_TRIP);
+	put_raw(b, &trip->when);
+	put_str(b, trip->location);
+	put_str(b, trip->notes);
+	for_each_dive (i, dive) {
+		if (dive->divetrip == trip)
+			write_dive(b, dive, false);
+	}
+	put_u32(b, SNAPSHOT_TRIP_END);
+}
+
+/*
+ * The same walk over a dive, with the values the pointers point to
+ * but not the pointers themselves, gives a hash of everything it
+ * contains. It tells the git saving code if it has seen exactly this
+ * dive before, and it's the same for any copy of the dive, in this
+ * run or the next. Like the snapshot itself, it depends on the layout
+ * of our structures, so it's only good for this build.
+ */
+void hash_dive(struct dive *dive, unsigned char hash[20])
+{
+	struct membuffer buf = { 0 };
+	struct dive copy;
+
+	/* memcpy rather than assignment, so the padding is the same every time */
+	memcpy(&copy, dive, sizeof(copy));
+
+	/* Where the dive sits in the lists and on screen doesn't matter, nor its id in this run */
+	copy.selected = false;
+	copy.hidden_by_filter = false;
+	copy.id = 0;
+	memset(copy.git_id, 0, sizeof(copy.git_id));
+
+	write_dive(&buf, &copy, true);
+	SHA1(buf.buffer, buf.len, hash);
+	free_buffer(&buf);
+}
+
+void save_snapshot(const char *name, const char *key)
+{
+	struct membuffer buf = { 0 };
+	struct dive *dive;
+	dive_trip_t *trip;
+	char *tmpname;
+	FILE *f;
+	int i;
+
+	if (!name || !key)
+		return;
+
+	put_bytes(&buf, SNAPSHOT_MAGIC, 8);
+	put_u32(&buf, SNAPSHOT_VERSION);
+	for (i = 0; i < NR_SIZES; i++)
+		put_u32(&buf, snapshot_sizes[i]);
+	put_str(&buf, key);
+	put_u32(&buf, autogroup);
+	put_str(&buf, prefs.save_userid_local ? prefs.userid : NULL);
+
+	call_for_each_dc(&buf, write_device);
+	for (i = 0; i < dive_site_table.nr; i++)
+		write_site(&buf, get_dive_site(i));
+
+	/* Trips are written along with their dives, the same way save_dives_buffer() does it */
+	for (trip = dive_trip_list; trip != NULL; trip = trip->next)
+		trip->index = 0;
+	for_each_dive (i, dive) {
+		trip = dive->divetrip;
+		if (!trip) {
+			write_dive(&buf, dive, false);
+			continue;
+		}
+		if (trip->index)
+			continue;
+		trip->index = 1;
+		write_trip(&buf, trip);
+	}
+	put_u32(&buf, SNAPSHOT_END);
+
+	/*
+	 * Write it to a file of its own first and only then put it in place,
+	 * so that a crash (or a full disk) leaves the old snapshot or none,
+	 * never a damaged one.
+	 */
+	tmpname = format_string("%s.tmp", name);
+	f = subsurface_fopen(tmpname, "wb");
+	if (f) {
+		bool ok = fwrite(buf.buffer, 1, buf.len, f) == buf.len;
+
+		if (fclose(f))
+			ok = false;
+		/* Windows doesn't rename over an existing file */
+		if (ok && subsurface_rename(tmpname, name)) {
+			remove(name);
+			ok = !subsurface_rename(tmpname, name);
+		}
+		if (!ok)
+			remove(tmpname);
+	}
+	free(tmpname);
+	free_buffer(&buf);
+}
+
+static void read_device(struct snapshot_reader *r)
+{
+	struct snapshot_device *dev = calloc(1, sizeof(*dev));
+
+	if (!dev)
+		exit(1);
+	dev->model = get_str(r);
+	dev->deviceid = get_u32(r);
+	dev->nickname = get_str(r);
+	dev->serial = get_str(r);
+	dev->firmware = get_str(r);
+	*r->last_device = dev;
+	r->last_device = &dev->next;
+}
+
+static void init_reader(struct snapshot_reader *r, struct memblock *mem)
+{
+	r->p = mem->buffer;
+	r->end = r->p + mem->size;
+	r->error = false;
+	r->devices = NULL;
+	r->last_device = &r->devices;
+	r->tags = NULL;
+	r->last_tag = &r->tags;
+}
+
+/* Add the devices and tags that were read to their lists, or just drop them */
+static void finish_reader(struct snapshot_reader *r, bool add_devices, bool add_tags)
+{
+	while (r->devices) {
+		struct snapshot_device *dev = r->devices;
+
+		if (add_devices)
+			create_device_node(dev->model, dev->deviceid, dev->serial, dev->firmware, dev->nickname);
+		r->devices = dev->next;
+		free(dev->model);
+		free(dev->nickname);
+		free(dev->serial);
+		free(dev->firmware);
+		free(dev);
+	}
+	while (r->tags) {
+		struct snapshot_tag *tag = r->tags;
+
+		if (add_tags)
+			taglist_add_tag(&tag->dive->tag_list, tag->tag);
+		r->tags = tag->next;
+		free(tag->tag);
+		free(tag);
+	}
+}
+
+static void read_site(struct snapshot_reader *r)
+{
+	struct dive_site *ds = alloc_dive_site();
+
+	get_raw(r, ds);
+	ds->name = get_str(r);
+	ds->description = get_str(r);
+	ds->notes = get_str(r);
+}
+
+static void read_dc(struct snapshot_reader *r, struct divecomputer *dc)
+{
+	struct event **evp;
+	struct extra_data **edp;
+	bool more;
+	int nr;
+
+	do {
+		get_raw(r, dc);
+		more = dc->next != NULL;
+		dc->next = NULL;
+		dc->model = get_str(r);
+		dc->serial = get_str(r);
+		dc->fw_version = get_str(r);
+
+		dc->sample = NULL;
+		if (dc->samples < 0 || (size_t)(r->end - r->p) / sizeof(struct sample) < dc->samples) {
+			r->error = true;
+			dc->samples = 0;
+		}
+		dc->alloc_samples = dc->samples;
+		if (dc->samples) {
+			dc->sample = malloc(dc->samples * sizeof(struct sample));
+			if (!dc->sample)
+				exit(1);
+			get_bytes(r, dc->sample, dc->samples * sizeof(struct sample));
+		}
+
+		dc->events = NULL;
+		evp = &dc->events;
+		for (nr = get_u32(r); nr > 0 && !r->error; nr--) {
+			struct event ev, *new;
+			char *name;
+
+			get_raw(r, &ev);
+			name = get_str(r);
+			if (!name)
+				break;
+			new = malloc(sizeof(*new) + strlen(name) + 1);
+			if (!new)
+				exit(1);
+			*new = ev;
+			strcpy(new->name, name);
+			free(name);
+			new->next = NULL;
+			*evp = new;
+			evp = &new->next;
+		}
+
+		dc->extra_data = NULL;
+		edp = &dc->extra_data;
+		for (nr = get_u32(r); nr > 0 && !r->error; nr--) {
+			struct extra_data *ed = malloc(sizeof(*ed));
+
+			if (!ed)
+				exit(1);
+			ed->key = get_str(r);
+			ed->value = get_str(r);
+			ed->next = NULL;
+			*edp = ed;
+			edp = &ed->next;
+		}
+
+		if (more && !r->error) {
+			dc->next = calloc(1, sizeof(*dc));
+			if (!dc->next)
+				exit(1);
+			dc = dc->next;
+		}
+	} while (more && !r->error);
+}
+
+static struct dive *read_dive(struct snapshot_reader *r)
+{
+	struct dive *dive = alloc_dive();
+	struct picture **picp;
+	int id = dive->id;
+	int i, nr;
+
+	get_raw(r, dive);
+
+	/* Nothing of this comes from the file */
+	dive->id = id;
+	dive->divetrip = NULL;
+	dive->next = NULL;
+	dive->pprev = NULL;
+	dive->selected = false;
+	dive->hidden_by_filter = false;
+	dive->downloaded = false;
+
+	dive->notes = get_str(r);
+	dive->divemaster = get_str(r);
+	dive->buddy = get_str(r);
+	dive->suit = get_str(r);
+	for (i = 0; i < MAX_CYLINDERS; i++)
+		dive->cylinder[i].type.description = get_str(r);
+	for (i = 0; i < MAX_WEIGHTSYSTEMS; i++)
+		dive->weightsystem[i].description = get_str(r);
+
+	dive->tag_list = NULL;
+	for (nr = get_u32(r); nr > 0 && !r->error; nr--) {
+		char *name = get_str(r);
+		struct snapshot_tag *tag;
+
+		if (!name)
+			continue;
+		tag = malloc(sizeof(*tag));
+		if (!tag)
+			exit(1);
+		tag->dive = dive;
+		tag->tag = name;
+		tag->next = NULL;
+		*r->last_tag = tag;
+		r->last_tag = &tag->next;
+	}
+
+	dive->picture_list = NULL;
+	picp = &dive->picture_list;
+	for (nr = get_u32(r); nr > 0 && !r->error; nr--) {
+		struct picture *pic = alloc_picture();
+
+		get_raw(r, pic);
+		pic->filename = get_str(r);
+		pic->hash = get_str(r);
+		pic->next = NULL;
+		*picp = pic;
+		picp = &pic->next;
+	}
+
+	read_dc(r, &dive->dc);
+	return dive;
+}
+
+/* A NULL key takes a snapshot of anything */
+static bool read_header(struct snapshot_reader *r, const char *key)
+{
+	char magic[8];
+	char *snapshot_key;
+	bool match;
+	int i;
+
+	if (!get_bytes(r, magic, sizeof(magic)) || memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)))
+		return false;
+	if (get_u32(r) != SNAPSHOT_VERSION)
+		return false;
+	for (i = 0; i < NR_SIZES; i++)
+		if (get_u32(r) != snapshot_sizes[i])
+			return false;
+	snapshot_key = get_str(r);
+	match = snapshot_key && (!key || !strcmp(snapshot_key, key));
+	free(snapshot_key);
+	return match && !r->error;
+}
+
+/* A snapshot is a whole dive log, so it can only stand in for a load into an empty one */
+bool snapshot_applies(void)
+{
+	return !dive_table.nr && !dive_site_table.nr && !dive_trip_list;
+}
+
+int load_snapshot(const char *name, const char *key)
+{
+	struct memblock mem;
+	struct snapshot_reader r;
+	dive_trip_t *trip = NULL;
+	uint32_t type, autogroup_state;
+	char *userid;
+	struct dive *dive;
+	int i;
+
+	if (!name || !key || !snapshot_applies())
+		return -1;
+	if (mapfile(name, &mem) <= 0)
+		return -1;
+	init_reader(&r, &mem);
+	if (!read_header(&r, key)) {
+		free_memblock(&mem);
+		return -1;
+	}
+	autogroup_state = get_u32(&r);
+	userid = get_str(&r);
+
+	while (!r.error && (type = get_u32(&r)) != SNAPSHOT_END) {
+		switch (type) {
+		case SNAPSHOT_DEVICE:
+			read_device(&r);
+			break;
+		case SNAPSHOT_SITE:
+			read_site(&r);
+			break;
+		case SNAPSHOT_TRIP:
+			if (trip) {
+				r.error = true;
+				break;
+			}
+			trip = calloc(1, sizeof(dive_trip_t));
+			if (!trip)
+				exit(1);
+			get_raw(&r, &trip->when);
+			trip->location = get_str(&r);
+			trip->notes = get_str(&r);
+			break;
+		case SNAPSHOT_TRIP_END:
+			if (!trip || !trip->dives) {
+				r.error = true;
+				break;
+			}
+			insert_trip(&trip);
+			trip = NULL;
+			break;
+		case SNAPSHOT_DIVE: {
+			struct dive *dive = read_dive(&r);
+
+			/* The dives were fixed up before they were written, so don't use record_dive() */
+			add_dive_to_table(dive, &dive_table);
+			if (trip) {
+				/* The trip keeps the date it was saved with */
+				timestamp_t when = trip->when;
+
+				add_dive_to_trip(dive, trip);
+				dive->tripflag = IN_TRIP;
+				trip->when = when;
+			}
+			break;
+		}
+		default:
+			r.error = true;
+		}
+	}
+	free_memblock(&mem);
+
+	if (trip) {
+		if (trip->dives) {
+			insert_trip(&trip);
+		} else {
+			free(trip->location);
+			free(trip->notes);
+			free(trip);
+		}
+		r.error = true;
+	}
+	if (r.error) {
+		/* Throw away whatever we got, the caller will parse the real file */
+		finish_reader(&r, false, false);
+		while (dive_table.nr)
+			delete_single_dive(0);
+		while (dive_site_table.nr)
+			delete_dive_site(get_dive_site(0)->uuid);
+		free(userid);
+		return -1;
+	}
+	finish_reader(&r, true, true);
+
+	/* No fixup_dive() for them, but the lists of equipment, events and devices need them */
+	for_each_dive (i, dive)
+		remember_dive_details(dive);
+
+	if (autogroup_state)
+		set_autogroup(true);
+	set_save_userid_local(userid != NULL);
+	set_userid(userid ?: "");
+	free(userid);
+	return 0;
+}
+
+/*
+ * Just the dives of a snapshot, whatever it was made from, for the
+ * git loader to pick the ones that haven't changed since. They are
+ * as they were written: fixed up, and in no trip.
+ */
+int load_snapshot_dives(const char *name, struct dive_table *table)
+{
+	struct memblock mem;
+	struct snapshot_reader r;
+	struct dive_site site;
+	timestamp_t when;
+	uint32_t type;
+	int i;
+
+	if (!name || mapfile(name, &mem) <= 0)
+		return -1;
+	init_reader(&r, &mem);
+	if (!read_header(&r, NULL)) {
+		free_memblock(&mem);
+		return -1;
+	}
+	get_u32(&r);
+	free(get_str(&r));
+
+	while (!r.error && (type = get_u32(&r)) != SNAPSHOT_END) {
+		switch (type) {
+		case SNAPSHOT_DEVICE:
+			read_device(&r);
+			break;
+		case SNAPSHOT_SITE:
+			get_raw(&r, &site);
+			for (i = 0; i < 3; i++)
+				free(get_str(&r));
+			break;
+		case SNAPSHOT_TRIP:
+			get_raw(&r, &when);
+			free(get_str(&r));
+			free(get_str(&r));
+			break;
+		case SNAPSHOT_TRIP_END:
+			break;
+		case SNAPSHOT_DIVE:
+			add_dive_to_table(read_dive(&r), table);
+			break;
+		default:
+			r.error = true;
+		}
+	}
+	free_memblock(&mem);
+
+	if (r.error) {
+		finish_reader(&r, false, false);
+		while (table->nr)
+			free_dive(table->dives[--table->nr]);
+		return -1;
+	}
+	/* the devices are the ones of the dive log we load, not of the snapshot */
+	finish_reader(&r, false, true);
+	return 0;
+}
+
+/* A file snapshot sits next to the file and is keyed by its size and modification time */
+static char *file_snapshot_key(const char *filename)
+{
+	struct stat st;
+	int fd, ret;
+
+	fd = subsurface_open(filename, O_RDONLY | O_BINARY, 0);
+	if (fd < 0)
+		return NULL;
+	ret = fstat(fd, &st);
+	close(fd);
+	if (ret < 0)
+		return NULL;
+	return format_string("%lld:%lld", (long long)st.st_size, (long long)st.st_mtime);
+}
+
+int load_file_snapshot(const char *filename)
+{
+	char *name = format_string("%s.snapshot", filename);
+	char *key = file_snapshot_key(filename);
+	int ret = load_snapshot(name, key);
+
+	free(name);
+	free(key);
+	return ret;
+}
+
+void save_file_snapshot(const char *filename)
+{
+	char *name = format_string("%s.snapshot", filename);
+	char *key = file_snapshot_key(filename);
+
+	save_snapshot(name, key);
+	free(name);
+	free(key);
+}
@@ -175,6 +175,7 @@ SOURCES =  \
 	save-git.c \
 	save-xml.c \
 	sha1.c \
+	snapshot.c \
 	statistics.c \
 	strtod.c \
 	subsurfacestartup.c \
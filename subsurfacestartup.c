@@ -50,6 +50,7 @@ struct preferences default_prefs = {
 	.display_runtime = true,
 	.display_duration = true,
 	.display_transitions = true,
+	.display_variations = false,
 	.recreational_mode = false,
 	.safetystop = true,
 	.bottomsac = 20000,
@@ -250,4 +251,5 @@ void free_prefs(void)
 	free(prefs.proxy_user);
 	free(prefs.proxy_pass);
 	free(prefs.userid);
+	free(prefs.gf_overlay);
 }
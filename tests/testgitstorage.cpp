@@ -0,0 +1,115 @@
+#include "testgitstorage.h"
+#include "testhelper.h"
+#include "divelist.h"
+#include <git2.h>
+#include <QDir>
+
+// what we have in memory right now, to compare with what a load gives
+static void saveReference()
+{
+	QCOMPARE(save_dives("./testgit.ssrf"), 0);
+}
+
+static void compareWithReference()
+{
+	QCOMPARE(save_dives("./testgitout.ssrf"), 0);
+	QCOMPARE(readFile("./testgitout.ssrf"), readFile("./testgit.ssrf"));
+}
+
+void TestGitStorage::initTestCase()
+{
+	git_repository *repo;
+	git_config *config;
+
+#if !LIBGIT2_VER_MAJOR && LIBGIT2_VER_MINOR < 22
+	git_threads_init();
+#else
+	git_libgit2_init();
+#endif
+	QDir("./testgit").removeRecursively();
+	// a bare repository, so that saving doesn't have a checkout to update
+	QCOMPARE(git_repository_init(&repo, "./testgit", true), 0);
+	QCOMPARE(git_repository_config(&config, repo), 0);
+	git_config_set_string(config, "user.name", "Subsurface");
+	git_config_set_string(config, "user.email", "subsurface@subsurface-divelog.org");
+	git_config_free(config);
+	char *snapshot = git_snapshot_name(repo);
+	snapshotName = snapshot;
+	free(snapshot);
+	git_repository_free(repo);
+}
+
+void TestGitStorage::testGitStorageLocal()
+{
+	clearDiveList();
+	QCOMPARE(parse_file(SUBSURFACE_SOURCE "/dives/test40-42.xml"), 0);
+	QCOMPARE(parse_file(SUBSURFACE_SOURCE "/dives/test43.xml"), 0);
+	process_dives(false, false);
+	saveReference();
+	QCOMPARE(save_dives("./testgit[master]"), 0);
+
+	// saving left a snapshot of the commit, loading it again gives the same dives
+	QVERIFY(QFile::exists(snapshotName));
+	clearDiveList();
+	QCOMPARE(parse_file("./testgit[master]"), 0);
+	compareWithReference();
+
+	// and so does the full parse of the tree without it
+	QVERIFY(QFile::remove(snapshotName));
+	clearDiveList();
+	QCOMPARE(parse_file("./testgit[master]"), 0);
+	compareWithReference();
+}
+
+void TestGitStorage::testGitTreeReuse()
+{
+	struct dive *dive;
+
+	// the trees of the dives that didn't change come from the last save
+	clearDiveList();
+	QCOMPARE(parse_file("./testgit[master]"), 0);
+	dive = get_dive(1);
+	free(dive->notes);
+	dive->notes = strdup("Changed after the last save");
+	saveReference();
+	QCOMPARE(save_dives("./testgit[master]"), 0);
+
+	// without the snapshot, what we load is what's in the new tree
+	QVERIFY(QFile::remove(snapshotName));
+	clearDiveList();
+	QCOMPARE(parse_file("./testgit[master]"), 0);
+	compareWithReference();
+}
+
+void TestGitStorage::testGitOldSnapshot()
+{
+	struct dive *dive;
+
+	// keep the snapshot of the commit we start from
+	clearDiveList();
+	QCOMPARE(parse_file("./testgit[master]"), 0);
+	QFile::remove("./testgit-old.snapshot");
+	QVERIFY(QFile::copy(snapshotName, "./testgit-old.snapshot"));
+	dive = get_dive(2);
+	free(dive->notes);
+	dive->notes = strdup("Changed after the snapshot");
+	saveReference();
+	QCOMPARE(save_dives("./testgit[master]"), 0);
+
+	// with the snapshot of the commit before, only the changed dive gets parsed
+	QVERIFY(QFile::remove(snapshotName));
+	QVERIFY(QFile::copy("./testgit-old.snapshot", snapshotName));
+	clearDiveList();
+	QCOMPARE(parse_file("./testgit[master]"), 0);
+	QCOMPARE(git_old_dives_used, dive_table.nr - 1);
+	compareWithReference();
+
+	// without it every dive gets parsed
+	QVERIFY(QFile::remove(snapshotName));
+	clearDiveList();
+	QCOMPARE(parse_file("./testgit[master]"), 0);
+	QCOMPARE(git_old_dives_used, 0);
+	compareWithReference();
+}
+
+QTEST_MAIN(TestGitStorage)
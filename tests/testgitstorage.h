@@ -0,0 +1,18 @@
+#ifndef TESTGITSTORAGE_H
+#define TESTGITSTORAGE_H
+
+#include <QtTest>
+
+class TestGitStorage : public QObject {
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void testGitStorageLocal();
+	void testGitTreeReuse();
+	void testGitOldSnapshot();
+
+private:
+	QString snapshotName;
+};
+
+#endif
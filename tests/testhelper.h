@@ -0,0 +1,25 @@
+#ifndef TESTHELPER_H
+#define TESTHELPER_H
+
+#include "dive.h"
+#include <QFile>
+#include <QTextStream>
+
+// start from an empty dive list, the tests before pile up their dives
+static inline void clearDiveList()
+{
+	while (dive_table.nr)
+		delete_single_dive(0);
+	while (dive_site_table.nr)
+		delete_dive_site(get_dive_site(0)->uuid);
+}
+
+static inline QString readFile(const QString &name)
+{
+	QFile file(name);
+	file.open(QFile::ReadOnly);
+	QTextStream stream(&file);
+	return stream.readAll();
+}
+
+#endif
@@ -1,6 +1,5 @@
 #include "testparse.h"
-#include "dive.h"
-#include <QTextStream>
+#include "testhelper.h"
 
 void TestParse::testParseCSV()
 {
@@ -43,15 +42,62 @@ void TestParse::testParseV2YesQuestion()
 void TestParse::testParseCompareOutput()
 {
 	QCOMPARE(save_dives("./testout.ssrf"), 0);
-	QFile org(SUBSURFACE_SOURCE "/dives/test40-42.xml");
-	org.open(QFile::ReadOnly);
-	QFile out("./testout.ssrf");
-	out.open(QFile::ReadOnly);
-	QTextStream orgS(&org);
-	QTextStream outS(&out);
-	QString readin = orgS.readAll();
-	QString written = outS.readAll();
-	QCOMPARE(readin, written);
+	QCOMPARE(readFile("./testout.ssrf"), readFile(SUBSURFACE_SOURCE "/dives/test40-42.xml"));
+
+	// reading back what we wrote and saving it again gives the same file
+	clearDiveList();
+	QCOMPARE(parse_file("./testout.ssrf"), 0);
+	QCOMPARE(save_dives("./testout2.ssrf"), 0);
+	QCOMPARE(readFile("./testout2.ssrf"), readFile("./testout.ssrf"));
+}
+
+void TestParse::testParseCompareCSVOutput()
+{
+	struct dive *dive;
+	int i;
+
+	// the generic CSV format doesn't go through csv2xml.xslt anymore, the
+	// expected dives are what it used to give
+	clearDiveList();
+	QCOMPARE(parse_csv_file(SUBSURFACE_SOURCE "/dives/Test.csv",
+				0, 1, 15, 6, 17, -1, -1, 18, -1, // time, depth, temp, po2, cns, ndl, tts, stopdepth, pressure
+				0, "csv", 0), 0); // tab separator, metric units
+	QCOMPARE(parse_csv_file(SUBSURFACE_SOURCE "/dives/TestComma.csv",
+				0, 1, 15, 6, 17, -1, -1, 18, -1,
+				1, "csv", 0), 0); // comma separator, metric units
+	QCOMPARE(parse_csv_file(SUBSURFACE_SOURCE "/dives/Test.csv",
+				0, 1, 15, 6, 17, -1, -1, 18, -1,
+				0, "csv", 1), 0); // tab separator, imperial units
+	// Test.csv has no non-zero po2, cns or stop values, TestCSVdeco.csv does
+	QCOMPARE(parse_csv_file(SUBSURFACE_SOURCE "/dives/TestCSVdeco.csv",
+				0, 1, 2, 3, 4, 5, 6, 7, 8,
+				0, "csv", 0), 0); // tab separator, metric units
+	QCOMPARE(parse_csv_file(SUBSURFACE_SOURCE "/dives/TestCSVdeco.csv",
+				0, 1, 2, 3, 4, 5, 6, 7, 8,
+				0, "csv", 1), 0); // tab separator, imperial units
+	QCOMPARE(dive_table.nr, 5);
+
+	// the dives are dated at the time of the import
+	for_each_dive (i, dive)
+		dive->when = dive->dc.when = 1445000000 + i * 7200;
+	QCOMPARE(save_dives("./testcsvout.ssrf"), 0);
+	QCOMPARE(readFile("./testcsvout.ssrf"), readFile(SUBSURFACE_SOURCE "/dives/TestCSVimport.xml"));
+}
+
+void TestParse::testParseTruncated()
+{
+	// a file the reader can't finish doesn't leave half of its dives behind
+	QString full = readFile(SUBSURFACE_SOURCE "/dives/test40-42.xml");
+	QFile truncated("./testtruncated.ssrf");
+	truncated.open(QFile::WriteOnly);
+	QTextStream(&truncated) << full.left(full.length() / 2);
+	truncated.close();
+
+	clearDiveList();
+	QCOMPARE(parse_file("./testtruncated.ssrf"), -1);
+	QCOMPARE(dive_table.nr, 0);
+	QCOMPARE(dive_site_table.nr, 0);
+	QVERIFY(dive_trip_list == NULL);
 }
 
 QTEST_MAIN(TestParse)
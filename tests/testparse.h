@@ -11,6 +11,8 @@ private slots:
 	void testParseV2YesQuestion();
 	void testParseV3();
 	void testParseCompareOutput();
+	void testParseCompareCSVOutput();
+	void testParseTruncated();
 };
 
 #endif
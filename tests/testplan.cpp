@@ -0,0 +1,80 @@
+#include "testplan.h"
+#include "dive.h"
+#include <math.h>
+
+Q_DECLARE_METATYPE(gasmix)
+
+static struct gasmix makeGasmix(int o2, int he)
+{
+	struct gasmix mix;
+
+	mix.o2.permille = o2;
+	mix.he.permille = he;
+	return mix;
+}
+
+void TestPlan::testAddSegments_data()
+{
+	QTest::addColumn<gasmix>("bottomGas");
+	QTest::addColumn<double>("bottomPressure");
+	QTest::addColumn<int>("bottomTime");
+	QTest::addColumn<gasmix>("decoGas");
+	QTest::addColumn<bool>("gfLowAtMaxdepth");
+
+	// off-gassing the helium on a nitrox
+	QTest::newRow("trimix to EAN50") << makeGasmix(180, 450) << 7.013 << 25 * 60 << makeGasmix(500, 0) << false;
+	QTest::newRow("trimix to EAN50, gf low at max depth") << makeGasmix(180, 450) << 7.013 << 25 * 60 << makeGasmix(500, 0) << true;
+	// the helium comes in faster than the nitrogen leaves, so the ceiling goes
+	// deeper than ever before during the stop and then comes up again
+	QTest::newRow("air to trimix") << makeGasmix(209, 0) << 5.013 << 30 * 60 << makeGasmix(100, 800) << false;
+	QTest::newRow("air to trimix, gf low at max depth") << makeGasmix(209, 0) << 5.013 << 30 * 60 << makeGasmix(100, 800) << true;
+}
+
+// add_segments() at a stop after a gas switch must leave the deco state where
+// adding the seconds one by one does
+void TestPlan::testAddSegments()
+{
+	QFETCH(gasmix, bottomGas);
+	QFETCH(double, bottomPressure);
+	QFETCH(int, bottomTime);
+	QFETCH(gasmix, decoGas);
+	QFETCH(bool, gfLowAtMaxdepth);
+	const double stopPressure = 3.113; // 21m
+	const int stopTime = 10 * 60;
+	struct dive *dive = alloc_dive();
+	char *start = NULL, *segments = NULL, *steps = NULL;
+	double tolerance;
+	int i;
+
+	set_gf(30, 85, gfLowAtMaxdepth);
+	clear_deco(1.013);
+	for (i = 0; i < 120; i++)
+		add_segment(1.013 + i * (bottomPressure - 1.013) / 120, &bottomGas, 1, 0, dive, prefs.bottomsac);
+	for (i = 0; i < bottomTime; i++)
+		add_segment(bottomPressure, &bottomGas, 1, 0, dive, prefs.bottomsac);
+	for (i = 0; i < 240; i++)
+		add_segment(bottomPressure - i * (bottomPressure - stopPressure) / 240, &bottomGas, 1, 0, dive, prefs.bottomsac);
+	cache_deco_state(0.0, &start);
+
+	tolerance = add_segments(stopPressure, &decoGas, 1, stopTime, 0, dive, prefs.decosac);
+	cache_deco_state(tolerance, &segments);
+	restore_deco_state(start);
+	for (i = 0; i < stopTime; i++)
+		tolerance = add_segment(stopPressure, &decoGas, 1, 0, dive, prefs.decosac);
+	cache_deco_state(tolerance, &steps);
+
+	// the N2 and He tissues, gf_low_pressure_this_dive and the tolerance
+	for (i = 0; i < 2 * 16 + 2; i++) {
+		double expected = ((double *)steps)[i];
+		double result = ((double *)segments)[i];
+
+		QVERIFY2(fabs(result - expected) <= 1e-9 * fabs(expected),
+			 qPrintable(QString("value %1: %2 instead of %3").arg(i).arg(result, 0, 'f', 9).arg(expected, 0, 'f', 9)));
+	}
+	free(start);
+	free(segments);
+	free(steps);
+	free_dive(dive);
+}
+
+QTEST_MAIN(TestPlan)
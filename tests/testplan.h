@@ -0,0 +1,13 @@
+#ifndef TESTPLAN_H
+#define TESTPLAN_H
+
+#include <QtTest>
+
+class TestPlan : public QObject {
+	Q_OBJECT
+private slots:
+	void testAddSegments();
+	void testAddSegments_data();
+};
+
+#endif